@@ -0,0 +1,76 @@
+//
+//  AliasTable.cpp
+//  evo_sim
+//
+//  Walker alias tables for O(1) sampling from fixed discrete distributions.
+//
+
+#include "AliasTable.h"
+#include <vector>
+
+using namespace std;
+
+AliasTable::AliasTable(){
+    n = 0;
+    total = 0;
+}
+
+bool AliasTable::build(const double *weights, int num){
+    if (int(prob.size()) < num){
+        prob.resize(num);
+        alias.resize(num);
+    }
+    total = buildInto(weights, num, prob.data(), alias.data(), small, large);
+    if (total <= 0){
+        n = 0;
+        return false;
+    }
+    n = num;
+    return true;
+}
+
+double AliasTable::buildInto(const double *weights, int num, double *prob_out, int *alias_out, vector<int>& small_work, vector<int>& large_work){
+    double sum = 0;
+    for (int i=0; i<num; i++){
+        sum += weights[i];
+    }
+    if (num == 0 || sum <= 0){
+        return 0;
+    }
+    small_work.clear();
+    large_work.clear();
+    small_work.reserve(num);
+    large_work.reserve(num);
+
+    // scale so the average weight is 1, then pair each underfull column with an overfull one
+    double scale = num / sum;
+    for (int i=0; i<num; i++){
+        prob_out[i] = weights[i] * scale;
+        alias_out[i] = i;
+        if (prob_out[i] < 1.0){
+            small_work.push_back(i);
+        }
+        else{
+            large_work.push_back(i);
+        }
+    }
+    while (!small_work.empty() && !large_work.empty()){
+        int s = small_work.back();
+        small_work.pop_back();
+        int l = large_work.back();
+        alias_out[s] = l;
+        prob_out[l] -= 1.0 - prob_out[s];
+        if (prob_out[l] < 1.0){
+            large_work.pop_back();
+            small_work.push_back(l);
+        }
+    }
+    // whatever is left over is full up to rounding error
+    for (vector<int>::iterator it = large_work.begin(); it != large_work.end(); ++it){
+        prob_out[*it] = 1.0;
+    }
+    for (vector<int>::iterator it = small_work.begin(); it != small_work.end(); ++it){
+        prob_out[*it] = 1.0;
+    }
+    return sum;
+}
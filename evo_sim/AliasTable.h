@@ -0,0 +1,72 @@
+//
+//  AliasTable.hpp
+//  evo_sim
+//
+//  Walker alias tables for O(1) sampling from fixed discrete distributions.
+//
+
+#ifndef AliasTable_h
+#define AliasTable_h
+
+#include <stdio.h>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+class AliasTable{
+    /* draws an index from a fixed discrete distribution in O(1) using a single uniform draw.
+     build() is O(n) and should be called whenever the weights change. storage is kept between builds, so rebuilding a table that is no larger than before does not allocate.
+     */
+private:
+    vector<double> prob;
+    vector<int> alias;
+    vector<int> small;
+    vector<int> large;
+    int n;
+    double total;
+public:
+    AliasTable();
+
+    /* @param weights nonnegative (unnormalized) weights
+     @param num number of weights
+     @return false iff no weight is positive. the table is empty in that case and should not be sampled.
+     */
+    bool build(const double *weights, int num);
+    bool build(const vector<double>& weights){
+        return build(weights.data(), int(weights.size()));
+    }
+
+    /* builds a table of length num into caller-owned arrays, so many small tables can share flat storage.
+     small_work and large_work are scratch space and are resized as needed.
+     @return sum of the weights
+     */
+    static double buildInto(const double *weights, int num, double *prob_out, int *alias_out, vector<int>& small_work, vector<int>& large_work);
+
+    // @return index drawn from a table stored in flat arrays by buildInto
+    static int sampleFrom(const double *prob_in, const int *alias_in, int num, std::mt19937& rng){
+        uniform_real_distribution<double> runif;
+        double u = runif(rng) * num;
+        int i = int(u);
+        if (i >= num){
+            i = num - 1;
+        }
+        return (u - i < prob_in[i]) ? i : alias_in[i];
+    }
+
+    // @return index drawn with probability proportional to its weight
+    int sample(std::mt19937& rng){
+        return sampleFrom(prob.data(), alias.data(), n, rng);
+    }
+    int size(){
+        return n;
+    }
+    bool isEmpty(){
+        return n == 0;
+    }
+    double getTotal(){
+        return total;
+    }
+};
+
+#endif /* AliasTable_h */
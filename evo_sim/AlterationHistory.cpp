@@ -0,0 +1,258 @@
+//
+//  AlterationHistory.cpp
+//  evo_sim
+//
+//  Histories of fitness alterations for clones that forget alterations: a fixed-capacity FIFO for a set number of generations,
+//  and a history shared between relatives for alterations with random lifetimes.
+//
+
+#include "AlterationHistory.h"
+#include <string.h>
+
+// free blocks of one capacity, each holding a pointer to the next in its first bytes
+struct FreeBlocks{
+    int capacity;
+    double *head;
+};
+
+// a simulation thread's free lists, one per capacity in use. capacities are fixed per clone line, so there are only a few.
+static __thread vector<FreeBlocks> *free_lists = NULL;
+
+static FreeBlocks& freeListFor(int capacity){
+    if (!free_lists){
+        free_lists = new vector<FreeBlocks>();
+    }
+    for (size_t i=0; i<free_lists->size(); i++){
+        if ((*free_lists)[i].capacity == capacity){
+            return (*free_lists)[i];
+        }
+    }
+    FreeBlocks list;
+    list.capacity = capacity;
+    list.head = NULL;
+    free_lists->push_back(list);
+    return free_lists->back();
+}
+
+static double* takeBlock(int capacity){
+    FreeBlocks& list = freeListFor(capacity);
+    if (!list.head){
+        return new double[capacity];
+    }
+    double *block = list.head;
+    memcpy(&list.head, block, sizeof(double *));
+    return block;
+}
+
+static void giveBlock(double *block, int capacity){
+    FreeBlocks& list = freeListFor(capacity);
+    memcpy(block, &list.head, sizeof(double *));
+    list.head = block;
+}
+
+void AlterationHistory::clearFreeLists(){
+    if (!free_lists){
+        return;
+    }
+    for (size_t i=0; i<free_lists->size(); i++){
+        double *block = (*free_lists)[i].head;
+        while (block){
+            double *next;
+            memcpy(&next, block, sizeof(double *));
+            delete[] block;
+            block = next;
+        }
+    }
+    delete free_lists;
+    free_lists = NULL;
+}
+
+AlterationHistory::AlterationHistory(){
+    values = inline_values;
+    capacity = INLINE_CAPACITY;
+    head = 0;
+    count = 0;
+}
+
+AlterationHistory::AlterationHistory(const AlterationHistory& other){
+    values = inline_values;
+    capacity = INLINE_CAPACITY;
+    allocate(other.capacity);
+    memcpy(values, other.values, sizeof(double) * other.capacity);
+    head = other.head;
+    count = other.count;
+}
+
+AlterationHistory& AlterationHistory::operator=(const AlterationHistory& other){
+    if (this != &other){
+        if (capacity != other.capacity){
+            allocate(other.capacity);
+        }
+        memcpy(values, other.values, sizeof(double) * other.capacity);
+        head = other.head;
+        count = other.count;
+    }
+    return *this;
+}
+
+AlterationHistory::~AlterationHistory(){
+    release();
+}
+
+void AlterationHistory::release(){
+    if (values != inline_values){
+        giveBlock(values, capacity);
+        values = inline_values;
+    }
+}
+
+void AlterationHistory::allocate(int new_capacity){
+    release();
+    if (new_capacity > INLINE_CAPACITY){
+        values = takeBlock(new_capacity);
+    }
+    capacity = new_capacity;
+}
+
+void AlterationHistory::setCapacity(int new_capacity){
+    if (new_capacity < 1){
+        new_capacity = 1;
+    }
+    if (new_capacity != capacity){
+        allocate(new_capacity);
+    }
+    head = 0;
+    count = 0;
+}
+
+SharedAlterationHistory::SharedAlterationHistory(){
+    spine = NULL;
+}
+
+SharedAlterationHistory::SharedAlterationHistory(const SharedAlterationHistory& other){
+    spine = other.spine;
+    if (spine){
+        spine->refs++;
+    }
+}
+
+SharedAlterationHistory& SharedAlterationHistory::operator=(const SharedAlterationHistory& other){
+    if (spine != other.spine){
+        release();
+        spine = other.spine;
+        if (spine){
+            spine->refs++;
+        }
+    }
+    return *this;
+}
+
+SharedAlterationHistory::~SharedAlterationHistory(){
+    release();
+}
+
+void SharedAlterationHistory::releaseChunk(Chunk *chunk){
+    chunk->refs--;
+    if (chunk->refs == 0){
+        delete chunk;
+    }
+}
+
+void SharedAlterationHistory::release(){
+    if (!spine){
+        return;
+    }
+    spine->refs--;
+    if (spine->refs == 0){
+        for (size_t i=0; i<spine->pieces.size(); i++){
+            releaseChunk(spine->pieces[i].chunk);
+        }
+        delete spine;
+    }
+    spine = NULL;
+}
+
+void SharedAlterationHistory::detach(){
+    if (!spine){
+        spine = new Spine();
+        spine->refs = 1;
+        spine->total = 0;
+    }
+    else if (spine->refs > 1){
+        Spine *copy = new Spine(*spine);
+        copy->refs = 1;
+        for (size_t i=0; i<copy->pieces.size(); i++){
+            copy->pieces[i].chunk->refs++;
+        }
+        spine->refs--;
+        spine = copy;
+    }
+}
+
+void SharedAlterationHistory::detachChunk(int i){
+    Piece& piece = spine->pieces[i];
+    if (piece.chunk->refs > 1){
+        Chunk *copy = new Chunk();
+        copy->refs = 1;
+        copy->used = piece.length;
+        memcpy(copy->values, piece.chunk->values, sizeof(double) * piece.length);
+        releaseChunk(piece.chunk);
+        piece.chunk = copy;
+    }
+}
+
+void SharedAlterationHistory::push(double alteration){
+    detach();
+    if (!spine->pieces.empty()){
+        Piece& last = spine->pieces.back();
+        if (last.length < CHUNK_SIZE && (last.chunk->refs == 1 || last.length == last.chunk->used)){
+            last.chunk->values[last.length] = alteration;
+            last.length++;
+            last.chunk->used = last.length;
+            spine->total++;
+            return;
+        }
+    }
+    Chunk *chunk = new Chunk();
+    chunk->refs = 1;
+    chunk->used = 1;
+    chunk->values[0] = alteration;
+    Piece piece;
+    piece.chunk = chunk;
+    piece.length = 1;
+    spine->pieces.push_back(piece);
+    spine->total++;
+}
+
+double SharedAlterationHistory::removeAt(int index){
+    detach();
+    vector<Piece>& pieces = spine->pieces;
+    int i = 0;
+    while (index >= pieces[i].length){
+        index -= pieces[i].length;
+        i++;
+    }
+    detachChunk(i);
+    Piece& piece = pieces[i];
+    double *values = piece.chunk->values;
+    double removed = values[index];
+    memmove(values + index, values + index + 1, sizeof(double) * (piece.length - index - 1));
+    piece.length--;
+    piece.chunk->used = piece.length;
+    spine->total--;
+
+    if (piece.length == 0){
+        releaseChunk(piece.chunk);
+        pieces.erase(pieces.begin() + i);
+    }
+    // fold a mostly empty chunk's successor into it so the piece list stays short
+    else if (piece.length < CHUNK_SIZE/4 && i+1 < int(pieces.size()) && piece.length + pieces[i+1].length <= CHUNK_SIZE){
+        Piece& next = pieces[i+1];
+        memcpy(values + piece.length, next.chunk->values, sizeof(double) * next.length);
+        piece.length += next.length;
+        piece.chunk->used = piece.length;
+        releaseChunk(next.chunk);
+        pieces.erase(pieces.begin() + i + 1);
+    }
+    return removed;
+}
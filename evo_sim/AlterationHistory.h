@@ -0,0 +1,137 @@
+//
+//  AlterationHistory.hpp
+//  evo_sim
+//
+//  Histories of fitness alterations for clones that forget alterations: a fixed-capacity FIFO for a set number of generations,
+//  and a history shared between relatives for alterations with random lifetimes.
+//
+
+#ifndef AlterationHistory_h
+#define AlterationHistory_h
+
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+class AlterationHistory{
+    /* ring buffer of at most capacity alterations, oldest first. the capacity is fixed when the clone is read in.
+     histories of up to INLINE_CAPACITY alterations are stored inside the object itself, so copying one into a daughter clone is a single block copy with no allocation.
+     longer histories use one block of exactly the capacity. blocks are returned to a per-thread free list for their capacity when a history is destroyed,
+     so once a population has reached its size, births take the block of an earlier death instead of allocating.
+     */
+public:
+    static const int INLINE_CAPACITY = 16;
+private:
+    double inline_values[INLINE_CAPACITY];
+    double *values;
+    int capacity;
+    int head;
+    int count;
+    void allocate(int new_capacity);
+    void release();
+public:
+    AlterationHistory();
+    AlterationHistory(const AlterationHistory& other);
+    AlterationHistory& operator=(const AlterationHistory& other);
+    ~AlterationHistory();
+
+    // empties the history and sets how many alterations it can hold
+    void setCapacity(int new_capacity);
+    // frees the blocks on this thread's free lists. call once the thread's histories have been destroyed.
+    static void clearFreeLists();
+
+    int size() const{
+        return count;
+    }
+    double front() const{
+        return values[head];
+    }
+    // adds an alteration after the newest one. the history must not be full.
+    void push(double alteration){
+        int pos = head + count;
+        if (pos >= capacity){
+            pos -= capacity;
+        }
+        values[pos] = alteration;
+        count++;
+    }
+    // removes the oldest alteration
+    void pop(){
+        head++;
+        if (head == capacity){
+            head = 0;
+        }
+        count--;
+    }
+    /* removes the oldest alteration and adds a new one in its place. for a full history this is the same as pop() then push().
+     @return removed alteration
+     */
+    double replaceOldest(double alteration){
+        double oldest = values[head];
+        if (count == capacity){
+            values[head] = alteration;
+            head++;
+            if (head == capacity){
+                head = 0;
+            }
+        }
+        else{
+            pop();
+            push(alteration);
+        }
+        return oldest;
+    }
+};
+
+class SharedAlterationHistory{
+    /* alterations oldest first, stored in chunks of up to CHUNK_SIZE. a history is a reference counted list of (chunk, length) pieces that relatives share:
+     copying a history only takes a reference, and a history copies its piece list or a chunk only when it changes one that another history still uses.
+     memory for a lineage therefore grows with the number of distinct alterations rather than with the number of cells times the history length.
+     */
+public:
+    static const int CHUNK_SIZE = 32;
+private:
+    struct Chunk{
+        int refs;
+        // slots written so far. a history using the first used slots may append in place even while the chunk is shared.
+        int used;
+        double values[CHUNK_SIZE];
+    };
+    struct Piece{
+        Chunk *chunk;
+        int length;
+    };
+    struct Spine{
+        int refs;
+        int total;
+        vector<Piece> pieces;
+    };
+    // NULL for an empty history
+    Spine *spine;
+
+    static void releaseChunk(Chunk *chunk);
+    void release();
+    // makes the piece list private to this history
+    void detach();
+    // makes the chunk of piece i private to this history. the piece list must already be private.
+    void detachChunk(int i);
+public:
+    SharedAlterationHistory();
+    SharedAlterationHistory(const SharedAlterationHistory& other);
+    SharedAlterationHistory& operator=(const SharedAlterationHistory& other);
+    ~SharedAlterationHistory();
+
+    int size() const{
+        return spine ? spine->total : 0;
+    }
+    // adds an alteration after the newest one
+    void push(double alteration);
+    /* removes one alteration. later alterations move down by one.
+     @param index position of the alteration, 0 being the oldest
+     @return removed alteration
+     */
+    double removeAt(int index);
+};
+
+#endif /* AlterationHistory_h */
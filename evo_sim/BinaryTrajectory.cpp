@@ -0,0 +1,359 @@
+//
+//  BinaryTrajectory.cpp
+//  evo_sim
+//
+//  The columnar binary trajectory format (.bevo) written by during-simulation writers and read back by evo_convert.
+//
+
+#include "BinaryTrajectory.h"
+#include <string.h>
+#include <sstream>
+
+const char TrajectoryEncoder::MAGIC[4] = {'B', 'E', 'V', 'O'};
+
+static void putBytes(string& dest, unsigned long long value, int num_bytes){
+    for (int i=0; i<num_bytes; i++){
+        dest.push_back(char(value & 0xff));
+        value >>= 8;
+    }
+}
+
+static void putVarint(string& dest, unsigned long long value){
+    while (value >= 0x80){
+        dest.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    dest.push_back(char(value));
+}
+
+static unsigned long long zigzag(long long value){
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value){
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+double TrajectoryDecoder::toReal(long long bits){
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+}
+
+long long TrajectoryDecoder::fromReal(double value){
+    long long bits;
+    memcpy(&bits, &value, sizeof(double));
+    return bits;
+}
+
+string TrajectoryDecoder::format(const TrajectoryColumn& column, long long bits){
+    if (column.type == TrajectoryColumn::INTEGER){
+        return to_string(bits);
+    }
+    if (column.style == TrajectoryColumn::FIXED){
+        return to_string(toReal(bits));
+    }
+    ostringstream ss;
+    ss << toReal(bits);
+    return ss.str();
+}
+
+TrajectoryEncoder::TrajectoryEncoder(){
+    out = NULL;
+    flags = 0;
+    header_written = false;
+    curr_column = 0;
+    num_rows = 0;
+}
+
+void TrajectoryEncoder::begin(ostream& new_out, const string& new_label, int new_flags){
+    out = &new_out;
+    label = new_label;
+    flags = new_flags;
+    header_written = false;
+    columns.clear();
+    values.clear();
+    curr_column = 0;
+    num_rows = 0;
+}
+
+void TrajectoryEncoder::addColumn(const string& name, TrajectoryColumn::Type type, TrajectoryColumn::Encoding encoding, TrajectoryColumn::Style style){
+    TrajectoryColumn column;
+    column.name = name;
+    column.type = type;
+    column.encoding = encoding;
+    column.style = style;
+    columns.push_back(column);
+    values.push_back(vector<long long>());
+    values.back().reserve(BLOCK_ROWS);
+}
+
+void TrajectoryEncoder::put(long long bits){
+    if (curr_column >= int(columns.size())){
+        throw "too many values in trajectory row";
+    }
+    values[curr_column].push_back(bits);
+    curr_column++;
+}
+
+TrajectoryEncoder& TrajectoryEncoder::add(double value){
+    if (curr_column < int(columns.size()) && columns[curr_column].type == TrajectoryColumn::INTEGER){
+        put((long long)value);
+    }
+    else{
+        put(TrajectoryDecoder::fromReal(value));
+    }
+    return *this;
+}
+
+TrajectoryEncoder& TrajectoryEncoder::add(long long value){
+    if (curr_column < int(columns.size()) && columns[curr_column].type == TrajectoryColumn::REAL){
+        put(TrajectoryDecoder::fromReal(double(value)));
+    }
+    else{
+        put(value);
+    }
+    return *this;
+}
+
+void TrajectoryEncoder::endRow(){
+    if (curr_column != int(columns.size())){
+        throw "too few values in trajectory row";
+    }
+    curr_column = 0;
+    num_rows++;
+    if (num_rows == BLOCK_ROWS){
+        writeBlock();
+    }
+}
+
+void TrajectoryEncoder::writeHeader(){
+    block.assign(MAGIC, 4);
+    putBytes(block, VERSION, 1);
+    putBytes(block, flags, 1);
+    putBytes(block, columns.size(), 2);
+    putBytes(block, label.size(), 4);
+    block += label;
+    for (size_t i=0; i<columns.size(); i++){
+        putBytes(block, columns[i].type, 1);
+        putBytes(block, columns[i].encoding, 1);
+        putBytes(block, columns[i].style, 1);
+        putBytes(block, columns[i].name.size(), 1);
+        block += columns[i].name;
+    }
+    out->write(block.data(), block.size());
+    header_written = true;
+}
+
+void TrajectoryEncoder::writeBlock(){
+    if (!header_written){
+        writeHeader();
+    }
+    block.clear();
+    putBytes(block, num_rows, 4);
+    size_t data_start = block.size() + 20 * columns.size();
+    block.resize(data_start);
+    for (size_t c=0; c<columns.size(); c++){
+        vector<long long>& column = values[c];
+        bool is_real = columns[c].type == TrajectoryColumn::REAL;
+        long long min = column[0];
+        long long max = column[0];
+        size_t start = block.size();
+        long long prev = 0;
+        for (int i=0; i<num_rows; i++){
+            long long bits = column[i];
+            if (is_real){
+                double value = TrajectoryDecoder::toReal(bits);
+                if (value < TrajectoryDecoder::toReal(min)){
+                    min = bits;
+                }
+                if (value > TrajectoryDecoder::toReal(max)){
+                    max = bits;
+                }
+            }
+            else{
+                if (bits < min){
+                    min = bits;
+                }
+                if (bits > max){
+                    max = bits;
+                }
+            }
+            if (columns[c].encoding == TrajectoryColumn::DELTA){
+                putVarint(block, zigzag((long long)((unsigned long long)bits - (unsigned long long)prev)));
+                prev = bits;
+            }
+            else{
+                putBytes(block, bits, 8);
+            }
+        }
+        string column_header;
+        putBytes(column_header, min, 8);
+        putBytes(column_header, max, 8);
+        putBytes(column_header, block.size() - start, 4);
+        block.replace(4 + 20 * c, 20, column_header);
+        column.clear();
+    }
+    out->write(block.data(), block.size());
+    out->flush();
+    num_rows = 0;
+}
+
+void TrajectoryEncoder::finish(){
+    if (!out){
+        return;
+    }
+    if (num_rows > 0){
+        writeBlock();
+    }
+    if (!header_written){
+        writeHeader();
+    }
+    block.clear();
+    putBytes(block, 0, 4);
+    out->write(block.data(), block.size());
+    out = NULL;
+}
+
+TrajectoryDecoder::TrajectoryDecoder(){
+    file = NULL;
+    flags = 0;
+}
+
+TrajectoryDecoder::~TrajectoryDecoder(){
+    if (file){
+        fclose(file);
+    }
+}
+
+bool TrajectoryDecoder::open(const string& filename){
+    file = fopen(filename.c_str(), "rb");
+    return file != NULL;
+}
+
+bool TrajectoryDecoder::readBytes(void *dest, size_t length){
+    return fread(dest, 1, length, file) == length;
+}
+
+bool TrajectoryDecoder::readInt(unsigned long long& value, int num_bytes){
+    unsigned char bytes[8];
+    if (!readBytes(bytes, num_bytes)){
+        return false;
+    }
+    value = 0;
+    for (int i=num_bytes-1; i>=0; i--){
+        value = (value << 8) | bytes[i];
+    }
+    return true;
+}
+
+bool TrajectoryDecoder::nextSegment(){
+    char magic[4];
+    if (!readBytes(magic, 4)){
+        return false;
+    }
+    if (memcmp(magic, TrajectoryEncoder::MAGIC, 4) != 0){
+        throw "not a bevo file";
+    }
+    unsigned long long version, value, num_columns, length;
+    if (!readInt(version, 1) || !readInt(value, 1) || !readInt(num_columns, 2) || !readInt(length, 4)){
+        throw "truncated bevo header";
+    }
+    if (version != TrajectoryEncoder::VERSION){
+        throw "unsupported bevo version";
+    }
+    flags = int(value);
+    label.assign(length, ' ');
+    if (length > 0 && !readBytes(&label[0], length)){
+        throw "truncated bevo header";
+    }
+    columns.assign(num_columns, TrajectoryColumn());
+    for (size_t i=0; i<columns.size(); i++){
+        unsigned long long type, encoding, style;
+        if (!readInt(type, 1) || !readInt(encoding, 1) || !readInt(style, 1) || !readInt(length, 1)){
+            throw "truncated bevo header";
+        }
+        columns[i].type = TrajectoryColumn::Type(type);
+        columns[i].encoding = TrajectoryColumn::Encoding(encoding);
+        columns[i].style = TrajectoryColumn::Style(style);
+        columns[i].name.assign(length, ' ');
+        if (length > 0 && !readBytes(&columns[i].name[0], length)){
+            throw "truncated bevo header";
+        }
+    }
+    return true;
+}
+
+bool TrajectoryDecoder::nextBlock(){
+    unsigned long long value;
+    // a simulation cut short leaves a segment without its end marker
+    if (!readInt(value, 4) || value == 0){
+        return false;
+    }
+    block.num_rows = int(value);
+    block.min.resize(columns.size());
+    block.max.resize(columns.size());
+    block.length.resize(columns.size());
+    for (size_t i=0; i<columns.size(); i++){
+        unsigned long long min, max, length;
+        if (!readInt(min, 8) || !readInt(max, 8) || !readInt(length, 4)){
+            return false;
+        }
+        block.min[i] = (long long)min;
+        block.max[i] = (long long)max;
+        block.length[i] = (unsigned int)length;
+    }
+    return true;
+}
+
+bool TrajectoryDecoder::readBlock(vector<vector<long long> >& values){
+    values.resize(columns.size());
+    vector<unsigned char> data;
+    for (size_t c=0; c<columns.size(); c++){
+        data.resize(block.length[c]);
+        if (!data.empty() && !readBytes(&data[0], data.size())){
+            return false;
+        }
+        vector<long long>& column = values[c];
+        column.resize(block.num_rows);
+        size_t pos = 0;
+        long long prev = 0;
+        for (int i=0; i<block.num_rows; i++){
+            unsigned long long bits = 0;
+            if (columns[c].encoding == TrajectoryColumn::DELTA){
+                int shift = 0;
+                while (pos < data.size() && (data[pos] & 0x80)){
+                    bits |= (unsigned long long)(data[pos] & 0x7f) << shift;
+                    shift += 7;
+                    pos++;
+                }
+                if (pos >= data.size()){
+                    return false;
+                }
+                bits |= (unsigned long long)data[pos] << shift;
+                pos++;
+                prev = (long long)((unsigned long long)prev + (unsigned long long)unzigzag(bits));
+                column[i] = prev;
+            }
+            else{
+                if (pos + 8 > data.size()){
+                    return false;
+                }
+                for (int b=7; b>=0; b--){
+                    bits = (bits << 8) | data[pos + b];
+                }
+                pos += 8;
+                column[i] = (long long)bits;
+            }
+        }
+    }
+    return true;
+}
+
+bool TrajectoryDecoder::skipBlock(){
+    long total = 0;
+    for (size_t c=0; c<columns.size(); c++){
+        total += block.length[c];
+    }
+    return fseek(file, total, SEEK_CUR) == 0;
+}
@@ -0,0 +1,142 @@
+//
+//  BinaryTrajectory.hpp
+//  evo_sim
+//
+//  The columnar binary trajectory format (.bevo) written by during-simulation writers and read back by evo_convert.
+//
+
+#ifndef BinaryTrajectory_h
+#define BinaryTrajectory_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+/* a .bevo file is a sequence of segments, one per writer per simulation (files opened for appending may hold several).
+ all numbers are little endian.
+ segment header: "BEVO", u8 version, u8 flags, u16 number of columns, u32 label length, label,
+     then for each column: u8 type, u8 encoding, u8 text style, u8 name length, name.
+ block: u32 number of rows (0 ends the segment), then for each column: 8 byte min, 8 byte max, u32 data length,
+     then the data of each column in turn.
+ REAL values are stored as the bits of a double and INTEGER values as a signed 64 bit integer. a RAW column stores each value in 8 bytes,
+ a DELTA column stores the zigzag varint of each value minus the previous one (for REAL, of the difference of the bit patterns, so no precision is lost).
+ */
+struct TrajectoryColumn{
+    enum Type {REAL, INTEGER};
+    enum Encoding {RAW, DELTA};
+    enum Style {
+        // as written by ostream <<
+        STREAM,
+        // as written by to_string
+        FIXED
+    };
+    string name;
+    Type type;
+    Encoding encoding;
+    Style style;
+};
+
+class TrajectoryEncoder{
+    /* collects the rows a writer produces during one simulation and writes them to a stream in blocks of BLOCK_ROWS.
+     */
+public:
+    static const char MAGIC[4];
+    static const int VERSION = 1;
+    // consecutive rows with the same first column are one line of the text format
+    static const int GROUPED = 1;
+    // the last column is how many times the text format repeats the other columns after the first
+    static const int REPEATED = 2;
+    // rows are only written when a column after the first changes, and hold until the next row
+    static const int CHANGES = 4;
+    static const int BLOCK_ROWS = 4096;
+private:
+    ostream *out;
+    string label;
+    int flags;
+    bool header_written;
+    vector<TrajectoryColumn> columns;
+    // one vector of 64 bit patterns per column for the current block
+    vector<vector<long long> > values;
+    int curr_column;
+    int num_rows;
+    string block;
+
+    void writeHeader();
+    void writeBlock();
+    void put(long long bits);
+public:
+    TrajectoryEncoder();
+    /* starts a segment. columns are added with addColumn before the first row.
+     @param label first line of the text format
+     */
+    void begin(ostream& new_out, const string& new_label, int new_flags = 0);
+    void addColumn(const string& name, TrajectoryColumn::Type type, TrajectoryColumn::Encoding encoding = TrajectoryColumn::RAW, TrajectoryColumn::Style style = TrajectoryColumn::STREAM);
+    // sets the next column of the current row
+    TrajectoryEncoder& add(double value);
+    TrajectoryEncoder& add(long long value);
+    TrajectoryEncoder& add(int value){
+        return add((long long)value);
+    }
+    void endRow();
+    // writes the rows left over and ends the segment
+    void finish();
+    bool isActive(){
+        return out != NULL;
+    }
+};
+
+struct TrajectoryBlock{
+    int num_rows;
+    // per column: bit patterns of the smallest and largest value, and the length of the data
+    vector<long long> min;
+    vector<long long> max;
+    vector<unsigned int> length;
+};
+
+class TrajectoryDecoder{
+    /* reads a .bevo file segment by segment and block by block. blocks can be skipped using only their headers.
+     */
+private:
+    FILE *file;
+    string label;
+    int flags;
+    vector<TrajectoryColumn> columns;
+    TrajectoryBlock block;
+    bool readBytes(void *dest, size_t length);
+    bool readInt(unsigned long long& value, int num_bytes);
+public:
+    TrajectoryDecoder();
+    ~TrajectoryDecoder();
+    bool open(const string& filename);
+    // reads the next segment header. @return false at the end of the file
+    bool nextSegment();
+    const string& getLabel(){
+        return label;
+    }
+    int getFlags(){
+        return flags;
+    }
+    const vector<TrajectoryColumn>& getColumns(){
+        return columns;
+    }
+    /* reads the next block header of the current segment.
+     @return false at the end of the segment
+     */
+    bool nextBlock();
+    const TrajectoryBlock& getBlock(){
+        return block;
+    }
+    // decodes the current block into bit patterns, one vector per column. @return false if the file is truncated
+    bool readBlock(vector<vector<long long> >& values);
+    bool skipBlock();
+
+    static double toReal(long long bits);
+    static long long fromReal(double value);
+    // @return value of a column in the text format
+    static string format(const TrajectoryColumn& column, long long bits);
+};
+
+#endif /* BinaryTrajectory_h */
@@ -16,6 +16,10 @@
 #include <cstdlib>
 #include <chrono>
 #include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <limits>
 using namespace std;
 
 CList::CList(double death, MutationHandler& mut_handle, int max){
@@ -34,6 +38,9 @@ CList::CList(double death, MutationHandler& mut_handle, int max){
     recalc_birth = false;
     prev_fit = 0;
     new_fit = 0;
+    event_log = NULL;
+    phylogeny = NULL;
+    has_next_event = false;
 }
 
 CList::CList(){
@@ -50,6 +57,9 @@ CList::CList(){
     prev_fit = 0;
     new_fit = 0;
     new_type = 0;
+    event_log = NULL;
+    phylogeny = NULL;
+    has_next_event = false;
 }
 
 void CList::clearClones(){
@@ -73,9 +83,19 @@ void CList::refreshSim(){
     prev_fit = 0;
     new_fit = 0;
     new_type = 0;
+    has_next_event = false;
 }
 
 void SexReprPop::refreshSim(){
+    if (uses_pool){
+        // the pooled clones outlive this simulation's types
+        CellType *curr_type = root;
+        while (curr_type){
+            curr_type->detachClones();
+            curr_type = curr_type->getNext();
+        }
+        uses_pool = false;
+    }
     CList::refreshSim();
     is_extinct = false;
 }
@@ -96,16 +116,24 @@ void CList::insertCellType(CellType& new_type) {
     addCells(new_type.getNumCells(), new_type.getBirthRate());
     new_type.setCloneList(*this);
     num_types++;
+    if (event_log){
+        event_log->addType(new_type.getIndex(), new_type.getParent() ? new_type.getParent()->getIndex() : -1, false);
+    }
+    if (phylogeny){
+        phylogeny->addType(new_type.getIndex(), new_type.getParent() ? new_type.getParent()->getIndex() : -1, time, new_type.getNumCells());
+    }
+    if (new_type.getNumCells() > 0){
+        typeCountChanged(new_type, new_type.getNumCells());
+    }
 }
 
 void CList::deleteList()
 {
     CellType *to_delete = root;
-    CellType *next = to_delete->getNext();
-    while(next) {
-        to_delete = next;
-        next = to_delete->getNext();
+    while(to_delete) {
+        CellType *next = to_delete->getNext();
         delete to_delete;
+        to_delete = next;
     }
     
 }
@@ -142,12 +170,10 @@ void CList::advance()
 {
     uniform_real_distribution<double> runif;
     mut_model->reset();
-    double total_death = getTotalDeath();
-    if (tot_cell_count == 0){
-        tot_rate = 0;
-    }
-    double tot_birth = getTotalBirth();
-    time += -log(runif(*eng))/(tot_birth + total_death);
+    time = nextEventTime();
+    has_next_event = false;
+    double total_death = next_death;
+    double tot_birth = next_birth;
     double b_or_d = runif(*eng)*(tot_birth + total_death);
     if (b_or_d < (total_death)){
         if (death_var){
@@ -172,6 +198,20 @@ void CList::advance()
     }
 }
 
+double CList::nextEventTime(){
+    if (!has_next_event){
+        uniform_real_distribution<double> runif;
+        next_death = getTotalDeath();
+        if (tot_cell_count == 0){
+            tot_rate = 0;
+        }
+        next_birth = getTotalBirth();
+        next_time = time + -log(runif(*eng))/(next_birth + next_death);
+        has_next_event = true;
+    }
+    return next_time;
+}
+
 Clone& CList::chooseReproducer(){
     uniform_real_distribution<double> runif;
     
@@ -250,7 +290,7 @@ int CList::getNextType(){
     throw "tried to get a new type at max_types";
 }
 
-void CList::addCells(int num_cells, double b){
+void CList::addCells(long long num_cells, double b){
     tot_rate += b * num_cells;
     tot_cell_count += num_cells;
 }
@@ -261,7 +301,7 @@ void CList::removeCell(double b){
 }
 
 /*
-void CList::walkTypesAndWrite(ofstream& outfile, CellType& root){
+void CList::walkTypesAndWrite(ostream& outfile, CellType& root){
     outfile << root.getIndex() << ", " << root.isExtinct() << ", ";
     std::vector<CellType *> children = root.getChildren();
     for (int i=0; i<int(children.size()); i++){
@@ -278,7 +318,83 @@ void CList::walkTypesAndWrite(ofstream& outfile, CellType& root){
 }
 */
 
-void CList::walkTypesAndWrite(ofstream& outfile, CellType& root){
+void CList::trackFitness(FitnessHistogram& histogram){
+    fillHistogram(histogram);
+    fitness_histograms.push_back(&histogram);
+}
+
+void CList::untrackFitness(FitnessHistogram& histogram){
+    fitness_histograms.erase(std::remove(fitness_histograms.begin(), fitness_histograms.end(), &histogram), fitness_histograms.end());
+}
+
+void CList::fillHistogram(FitnessHistogram& histogram){
+    histogram.clear();
+    for (int i=0; i<max_types; i++){
+        if (!hasCellType(i) || (histogram.getType() >= 0 && histogram.getType() != i)){
+            continue;
+        }
+        Clone *curr_clone = getTypeByIndex(i)->getRoot();
+        while (curr_clone){
+            histogram.add(curr_clone->getBirthRate(), curr_clone->getCellCount());
+            curr_clone = &(curr_clone->getNextWithinType());
+        }
+    }
+}
+
+void CList::updateHistograms(int type_index, double b, long long num_cells){
+    for (vector<FitnessHistogram *>::iterator it = fitness_histograms.begin(); it != fitness_histograms.end(); ++it){
+        if ((*it)->getType() < 0 || (*it)->getType() == type_index){
+            (*it)->add(b, num_cells);
+        }
+    }
+}
+
+void CList::typeDetached(int type_index){
+    for (vector<FitnessHistogram *>::iterator it = fitness_histograms.begin(); it != fitness_histograms.end(); ++it){
+        if ((*it)->getType() < 0 || (*it)->getType() == type_index){
+            (*it)->markStale();
+        }
+    }
+    if (event_log){
+        event_log->typeDetached(type_index);
+    }
+    if (phylogeny){
+        phylogeny->cellsChanged(type_index, 0, time);
+    }
+}
+
+void CList::trackPhylogeny(Phylogeny& new_phylogeny){
+    new_phylogeny.clear(max_types);
+    CellType *curr_type = root;
+    while (curr_type){
+        new_phylogeny.addType(curr_type->getIndex(), curr_type->getParent() ? curr_type->getParent()->getIndex() : -1, time, curr_type->getNumCells());
+        curr_type = curr_type->getNext();
+    }
+    phylogeny = &new_phylogeny;
+}
+
+void CList::startLog(EventLog& log){
+    // every type first, so cell records only refer to types already in the log
+    CellType *curr_type = root;
+    while (curr_type){
+        bool is_root = std::find(root_types.begin(), root_types.end(), curr_type) != root_types.end();
+        log.addType(curr_type->getIndex(), curr_type->getParent() ? curr_type->getParent()->getIndex() : -1, is_root);
+        curr_type = curr_type->getNext();
+    }
+    curr_type = root;
+    while (curr_type){
+        Clone *curr_clone = curr_type->getRoot();
+        while (curr_clone){
+            log.cellsChanged(curr_type->getIndex(), curr_clone->getBirthRate(), curr_clone->getCellCount());
+            curr_clone = &(curr_clone->getNextWithinType());
+        }
+        curr_type = curr_type->getNext();
+    }
+    log.beginSteps(time);
+    event_log = &log;
+}
+
+void CList::walkTypesAndWrite(ostream& outfile, CellType& root){
     for (int i=0; i<max_types; i++){
         if (hasCellType(i)){
             outfile << i << ", " << getTypeByIndex(i)->getNumCells() << ", ";
@@ -346,52 +462,232 @@ void MoranPop::advance(){
     time++;
 }
 
-MoranPop::MoranPop() : CList(){}
+MoranPop::MoranPop() : CList(){
+    has_payoff = false;
+    num_payoff_types = 0;
+    selection = 0;
+}
+
+bool MoranPop::handle_line(vector<string>& parsed_line){
+    if (parsed_line[0] == "payoff"){
+        //full line syntax: pop_params payoff [payoff matrix filename] [selection strength]
+        if (parsed_line.size() < 3 || !readPayoffs(parsed_line[1])){
+            return false;
+        }
+        selection = stod(parsed_line[2]);
+        if (selection < 0 || selection > 1){
+            return false;
+        }
+        has_payoff = true;
+        // clones may have been read before this line
+        recomputePayoffSums();
+        return true;
+    }
+    return CList::handle_line(parsed_line);
+}
+
+bool MoranPop::readPayoffs(string filename){
+    // one row of the matrix per line, entries separated by commas or whitespace
+    ifstream infile;
+    infile.open(filename);
+    if (!infile.is_open()){
+        return false;
+    }
+    payoffs.clear();
+    int num_rows = 0;
+    string line;
+    while (getline(infile, line)){
+        const char *curr = line.c_str();
+        int num_cols = 0;
+        while (true){
+            while (*curr == ',' || isspace((unsigned char)*curr)){
+                curr++;
+            }
+            if (*curr == '\0'){
+                break;
+            }
+            char *end;
+            double payoff = strtod(curr, &end);
+            if (end == curr){
+                return false;
+            }
+            payoffs.push_back(payoff);
+            num_cols++;
+            curr = end;
+        }
+        if (num_cols > 0){
+            num_rows++;
+        }
+    }
+    if (num_rows == 0 || int(payoffs.size()) != num_rows * num_rows){
+        return false;
+    }
+    num_payoff_types = num_rows;
+    return true;
+}
+
+void MoranPop::recomputePayoffSums(){
+    payoff_sums.assign(num_payoff_types, 0);
+    CellType *curr_type = root;
+    while (curr_type){
+        typeCountChanged(*curr_type, curr_type->getNumCells());
+        curr_type = curr_type->getNext();
+    }
+}
+
+void MoranPop::typeCountChanged(CellType& type, long long num_cells){
+    int j = type.getIndex();
+    if (!has_payoff || j >= num_payoff_types){
+        return;
+    }
+    // rank-one update: column j of the payoff matrix, scaled by the change in n_j
+    const double *entry = &payoffs[j];
+    for (int i=0; i<num_payoff_types; i++){
+        payoff_sums[i] += entry[i * num_payoff_types] * num_cells;
+    }
+}
+
+double MoranPop::getPayoffFitness(CellType& type){
+    int i = type.getIndex();
+    double payoff = 0;
+    if (i < num_payoff_types && tot_cell_count > 1){
+        // a cell does not play against itself
+        payoff = (payoff_sums[i] - payoffs[i * num_payoff_types + i]) / (tot_cell_count - 1);
+    }
+    return fmax(0.0, 1 - selection + selection * payoff);
+}
+
+Clone& MoranPop::chooseReproducer(){
+    if (!has_payoff){
+        return CList::chooseReproducer();
+    }
+    type_weights.clear();
+    double total = 0;
+    CellType *curr_type = root;
+    while (curr_type){
+        double weight = (curr_type->getNumCells() > 0) ? getPayoffFitness(*curr_type) * curr_type->getBirthRate() : 0;
+        type_weights.push_back(weight);
+        total += weight;
+        curr_type = curr_type->getNext();
+    }
+    
+    uniform_real_distribution<double> runif;
+    double ran = runif(*eng) * total;
+    CellType *rep_type = NULL;
+    int i = 0;
+    curr_type = root;
+    while (curr_type){
+        if (type_weights[i] > 0){
+            rep_type = curr_type;
+            if (ran < type_weights[i]){
+                break;
+            }
+            ran -= type_weights[i];
+        }
+        curr_type = curr_type->getNext();
+        i++;
+    }
+    if (!rep_type){
+        return CList::chooseReproducer();
+    }
+    
+    // within the type, clones are chosen by birth rate alone, reusing the rest of the same draw
+    ran = ran / getPayoffFitness(*rep_type);
+    Clone *reproducer = rep_type->getRoot();
+    double curr_rate = reproducer->getTotalBirth();
+    Clone *next = &reproducer->getNextWithinType();
+    while (curr_rate < ran && next){
+        reproducer = next;
+        curr_rate += reproducer->getTotalBirth();
+        next = &reproducer->getNextWithinType();
+    }
+    return *reproducer;
+}
+
+void MoranPop::refreshSim(){
+    CList::refreshSim();
+    if (has_payoff){
+        payoff_sums.assign(num_payoff_types, 0);
+    }
+}
 
 SexReprPop::SexReprPop() : CList(){
     std::vector<int> male_types = std::vector<int>();
     std::vector<int> female_types = std::vector<int>();
     is_extinct = false;
+    curr_generation = 0;
+    uses_pool = false;
+}
+
+SexReprPop::~SexReprPop(){
+    for (int i=0; i<2; i++){
+        for (vector<SexReprClone *>::iterator it = generations[i].begin(); it != generations[i].end(); ++it){
+            (*it)->detach();
+            delete *it;
+        }
+    }
 }
 
 UpdateAllPop::UpdateAllPop() : CList(){
     timestep_length = 0;
+    uses_batch = false;
+    density_on = 0;
+    density_off = 0;
+    density_bins = 0;
 }
 
 void UpdateAllPop::advance(){
     mut_model->reset();
-    std::vector<Clone *> reproducers = std::vector<Clone *>();
-    std::vector<Clone *> dead = std::vector<Clone *>();
+    int num_threads = workers.getNumThreads();
+    thread_reproducers.resize(num_threads);
+    thread_dead.resize(num_threads);
+    for (int i=0; i<num_threads; i++){
+        thread_reproducers[i].clear();
+        thread_dead[i].clear();
+    }
     
-    CellType *curr_type = root;
-    while (curr_type->getNumCells() == 0){
-        curr_type = curr_type->getNext();
+    long long num_updates;
+    if (density_on > 0){
+        switchRepresentations();
+    }
+    uses_batch = tot_cell_count > 0 && diffusion_batch.size() + countDensityCells() == tot_cell_count;
+    if (uses_batch){
+        num_updates = diffusion_batch.size();
+        diffusion_batch.prepareStep();
     }
-    Clone *curr = curr_type->getRoot();
-    while (curr->getNextClone()){
-        curr->update(timestep_length);
-        if (curr->hasDied()){
-            dead.push_back(curr);
+    else{
+        update_clones.clear();
+        CellType *curr_type = root;
+        while (curr_type && curr_type->getNumCells() == 0){
+            curr_type = curr_type->getNext();
         }
-        else if (curr->hasReproduced()){
-            reproducers.push_back(curr);
+        Clone *curr = curr_type ? curr_type->getRoot() : NULL;
+        while (curr){
+            update_clones.push_back(curr);
+            curr = curr->getNextClone();
         }
-        curr = curr->getNextClone();
+        num_updates = update_clones.size();
     }
-    curr->update(timestep_length);
-    if (curr->hasDied()){
-        dead.push_back(curr);
-    }
-    else if (curr->hasReproduced()){
-        reproducers.push_back(curr);
+    workers.run(num_updates, updateRange, this);
+    if (!densities.empty()){
+        workers.run(densities.size(), stepDensities, this);
     }
+    mergeFlagged();
     
-    for (int i=0; i<reproducers.size(); i++){
+    // reproduce everything flagged this step before removing the dead
+    while (!reproducers.empty()){
         reproducers.back()->reproduce();
         reproducers.pop_back();
     }
     
-    for (int i=0; i<dead.size(); i++){
+    for (int i=0; i<int(densities.size()); i++){
+        if (!densities[i]->applyStep()){
+            removeDensity(*densities[i]);
+            i--;
+        }
+    }
+    
+    while (!dead.empty()){
         killCell(*dead.back());
         dead.pop_back();
     }
@@ -399,10 +695,160 @@ void UpdateAllPop::advance(){
     time += timestep_length;
 }
 
+void UpdateAllPop::updateRange(void *pop, int thread_id, long long begin, long long end){
+    UpdateAllPop *self = (UpdateAllPop *)pop;
+    std::vector<Clone *>& my_reproducers = self->thread_reproducers[thread_id];
+    std::vector<Clone *>& my_dead = self->thread_dead[thread_id];
+    if (self->uses_batch){
+        Diffusion1DBatch& batch = self->diffusion_batch;
+        batch.step(self->timestep_length, int(begin), int(end), *eng);
+        for (long long i=begin; i<end; i++){
+            unsigned char flags = batch.getFlags(int(i));
+            if (flags & Diffusion1DBatch::DIED){
+                my_dead.push_back(batch.getClone(int(i)));
+            }
+            else if (flags & Diffusion1DBatch::REPRODUCED){
+                my_reproducers.push_back(batch.getClone(int(i)));
+            }
+        }
+    }
+    else{
+        for (long long i=begin; i<end; i++){
+            Clone *curr = self->update_clones[i];
+            curr->update(self->timestep_length);
+            if (curr->hasDied()){
+                my_dead.push_back(curr);
+            }
+            else if (curr->hasReproduced()){
+                my_reproducers.push_back(curr);
+            }
+        }
+    }
+}
+
+void UpdateAllPop::stepDensities(void *pop, int thread_id, long long begin, long long end){
+    UpdateAllPop *self = (UpdateAllPop *)pop;
+    for (long long i=begin; i<end; i++){
+        self->densities[i]->step(self->timestep_length);
+    }
+}
+
+long long UpdateAllPop::countDensityCells(){
+    long long count = 0;
+    for (vector<Diffusion1DDensityClone *>::iterator it = densities.begin(); it != densities.end(); ++it){
+        count += (*it)->getCellCount();
+    }
+    return count;
+}
+
+void UpdateAllPop::switchRepresentations(){
+    // only types whose cells are all Diffusion1DClones, individually or in a density, can switch; other clone types may share the population
+    // all zero between steps: each entry counted here is cleared by the walk over the types below, so a step costs nothing per unused type index
+    if (int(batch_type_cells.size()) < max_types){
+        batch_type_cells.resize(max_types, 0);
+    }
+    for (int i=0; i<diffusion_batch.size(); i++){
+        batch_type_cells[diffusion_batch.getClone(i)->getType().getIndex()]++;
+    }
+    CellType *curr_type = root;
+    while (curr_type){
+        int index = curr_type->getIndex();
+        Diffusion1DDensityClone *density = (index < int(type_densities.size())) ? type_densities[index] : NULL;
+        if (density){
+            if (curr_type->getNumCells() > density->getCellCount() && curr_type->getNumCells() == density->getCellCount() + batch_type_cells[index]){
+                // individual cells arrived in this type (e.g. mutants of another type)
+                absorbClones(*curr_type, *density);
+            }
+            if (density->getCellCount() <= density_off){
+                density->dissolve();
+                removeDensity(*density);
+            }
+        }
+        else if (curr_type->getNumCells() >= density_on && curr_type->getNumCells() == batch_type_cells[index]){
+            condense(*curr_type);
+        }
+        batch_type_cells[index] = 0;
+        curr_type = curr_type->getNext();
+    }
+}
+
+void UpdateAllPop::condense(CellType& type){
+    // only types whose cells all share parameters are stored as densities
+    Diffusion1DClone& model = *(Diffusion1DClone *)type.getRoot();
+    Clone *curr = type.getRoot();
+    while (curr){
+        Diffusion1DClone *clone = (Diffusion1DClone *)curr;
+        if (clone->getBirthRate() != model.getBirthRate() || clone->getMutProb() != model.getMutProb() || clone->getDrift() != model.getDrift() || clone->getDiffusion() != model.getDiffusion() || clone->getThreshold() != model.getThreshold()){
+            return;
+        }
+        curr = (curr == type.getEnd()) ? NULL : &curr->getNextWithinType();
+    }
+    Diffusion1DDensityClone *density = new Diffusion1DDensityClone(model, density_bins);
+    type.insertClone(*density);
+    absorbClones(type, *density);
+    if (int(type_densities.size()) <= type.getIndex()){
+        type_densities.resize(type.getIndex() + 1, NULL);
+    }
+    type_densities[type.getIndex()] = density;
+    densities.push_back(density);
+}
+
+void UpdateAllPop::absorbClones(CellType& type, Diffusion1DDensityClone& density){
+    Clone *curr = type.getRoot();
+    while (curr){
+        Clone *next = (curr == type.getEnd()) ? NULL : &curr->getNextWithinType();
+        if (curr != &density){
+            Diffusion1DClone *clone = (Diffusion1DClone *)curr;
+            if (density.matches(*clone)){
+                density.absorb(*clone);
+                delete clone;
+            }
+        }
+        curr = next;
+    }
+}
+
+void UpdateAllPop::removeDensity(Diffusion1DDensityClone& density){
+    type_densities[density.getType().getIndex()] = NULL;
+    densities.erase(std::find(densities.begin(), densities.end(), &density));
+    delete &density;
+}
+
+void UpdateAllPop::refreshSim(){
+    // densities are deleted with their types
+    densities.clear();
+    type_densities.clear();
+    CList::refreshSim();
+}
+
+void UpdateAllPop::mergeFlagged(){
+    reproducers.clear();
+    dead.clear();
+    for (int i=0; i<int(thread_reproducers.size()); i++){
+        reproducers.insert(reproducers.end(), thread_reproducers[i].begin(), thread_reproducers[i].end());
+        dead.insert(dead.end(), thread_dead[i].begin(), thread_dead[i].end());
+    }
+}
+
 bool UpdateAllPop::handle_line(vector<string>& parsed_line){
     if (parsed_line[0] == "timestep"){
         timestep_length =stod(parsed_line[1]);
     }
+    else if (parsed_line[0] == "threads"){
+        workers.start(stoi(parsed_line[1]));
+    }
+    else if (parsed_line[0] == "density"){
+        //full line syntax: pop_params density [cells to switch to a density] [cells to switch back to clones] [number of bins]
+        if (parsed_line.size() < 4){
+            return false;
+        }
+        density_on = stoll(parsed_line[1]);
+        density_off = stoll(parsed_line[2]);
+        density_bins = stoi(parsed_line[3]);
+        if (density_on <= density_off || density_off < 0 || density_bins < 1){
+            return false;
+        }
+    }
     else{
         return CList::handle_line(parsed_line);
     }
@@ -410,6 +856,101 @@ bool UpdateAllPop::handle_line(vector<string>& parsed_line){
     return true;
 }
 
+DiffusionEventPop::DiffusionEventPop() : CList(){
+    is_scheduled = false;
+}
+
+DiffusionEventPop::~DiffusionEventPop(){
+    for (map<tuple<double, double, double>, DiffusionFirstPassage *>::iterator it = passage_samplers.begin(); it != passage_samplers.end(); ++it){
+        delete it->second;
+    }
+}
+
+void DiffusionEventPop::refreshSim(){
+    events = priority_queue<DiffusionEvent, vector<DiffusionEvent>, greater<DiffusionEvent> >();
+    is_scheduled = false;
+    CList::refreshSim();
+}
+
+DiffusionFirstPassage& DiffusionEventPop::getSampler(Diffusion1DClone& clone){
+    tuple<double, double, double> key(clone.getDrift(), clone.getDiffusion(), clone.getThreshold());
+    map<tuple<double, double, double>, DiffusionFirstPassage *>::iterator found = passage_samplers.find(key);
+    if (found != passage_samplers.end()){
+        return *found->second;
+    }
+    DiffusionFirstPassage *sampler = new DiffusionFirstPassage(clone.getDrift(), clone.getDiffusion(), clone.getThreshold());
+    passage_samplers[key] = sampler;
+    return *sampler;
+}
+
+void DiffusionEventPop::schedule(Diffusion1DClone& clone, double now){
+    uniform_real_distribution<double> runif;
+    double hitting_time = getSampler(clone).sampleHittingTime(fabs(clone.getPosition()), *eng);
+    double b = clone.getBirthRate();
+    double rate = b + clone.getDeathRate();
+    double wait = (rate > 0) ? -log(runif(*eng))/rate : numeric_limits<double>::infinity();
+    DiffusionEvent next;
+    next.start = now;
+    next.clone = &clone;
+    if (hitting_time <= wait){
+        if (std::isinf(hitting_time)){
+            // the clone never changes again
+            return;
+        }
+        next.time = now + hitting_time;
+        next.divides = false;
+    }
+    else{
+        next.time = now + wait;
+        next.divides = runif(*eng)*rate < b;
+    }
+    events.push(next);
+}
+
+void DiffusionEventPop::scheduleAll(){
+    for (int i=0; i<clone_state.size(); i++){
+        schedule(*clone_state.getClone(i), time);
+    }
+    is_scheduled = true;
+}
+
+double DiffusionEventPop::nextEventTime(){
+    if (!is_scheduled){
+        scheduleAll();
+    }
+    return events.empty() ? time : events.top().time;
+}
+
+void DiffusionEventPop::advance(){
+    mut_model->reset();
+    if (!is_scheduled){
+        scheduleAll();
+    }
+    if (events.empty()){
+        return;
+    }
+    DiffusionEvent next = events.top();
+    events.pop();
+    time = next.time;
+    Diffusion1DClone& clone = *next.clone;
+    if (!next.divides){
+        killCell(clone);
+        return;
+    }
+    // the position is only needed at divisions, conditional on the clone having stayed below its threshold since it was last known
+    double pos = clone.getPosition();
+    double dist = getSampler(clone).samplePosition(fabs(pos), time - next.start, *eng);
+    clone.setPosition((pos < 0) ? -dist : dist);
+    prev_fit = clone.getBirthRate();
+    Diffusion1DClone *daughter = clone.divide();
+    new_fit = daughter->getBirthRate();
+    if (mut_model->has_mut()){
+        new_type = mut_model->getNewType().getIndex();
+    }
+    schedule(clone, time);
+    schedule(*daughter, time);
+}
+
 bool SexReprPop::handle_line(vector<string>& parsed_line){
     if (parsed_line[0] == "male_types"){
         for (int i=1; i<parsed_line.size(); i++){
@@ -421,6 +962,9 @@ bool SexReprPop::handle_line(vector<string>& parsed_line){
             female_types.push_back(stoi(parsed_line[i]));
         }
     }
+    else if (parsed_line[0] == "threads"){
+        workers.start(stoi(parsed_line[1]));
+    }
     else{
         return CList::handle_line(parsed_line);
     }
@@ -430,45 +974,95 @@ bool SexReprPop::handle_line(vector<string>& parsed_line){
 
 void SexReprPop::advance(){
     mut_model->reset();
-    std::vector<SexReprClone *> new_cells = std::vector<SexReprClone *>();
-    std::vector<int> type_indices = std::vector<int>();
-    for (int i=0; i<tot_cell_count; i++){
-        SexReprClone* mother = &chooseMother();
-        SexReprClone* father = &chooseFather();
-        SexReprClone& new_cell = mother->reproduce(*father);
-        new_cells.push_back(&new_cell);
-        type_indices.push_back(new_cell.getType().getIndex());
-    }
-    double prev_time = time;
-    refreshSim();
-    for (vector<int>::iterator it = male_types.begin(); it != male_types.end(); ++it){
-        CellType *new_type = new CellType(*it, NULL);
-        insertCellType(*new_type);
-    }
-    for (vector<int>::iterator it = female_types.begin(); it != female_types.end(); ++it){
-        CellType *new_type = new CellType(*it, NULL);
-        insertCellType(*new_type);
+    if (!buildReproducerTable(female_types, mothers, mother_table) || !buildReproducerTable(male_types, fathers, father_table)){
+        // one sex has died out, so no further generations can be produced
+        is_extinct = true;
+        return;
     }
-    for (int i=0; i<new_cells.size(); i++){
-        SexReprClone* new_cell = new_cells[i];
-        int index = type_indices[i];
-        CellType *new_type = getTypeByIndex(index);
-        new_cell->setType(*new_type);
-        new_cell->getType().insertClone(*new_cell);
+    std::vector<SexReprClone *>& next_generation = generations[1 - curr_generation];
+    while ((long long)(next_generation.size()) < tot_cell_count){
+        next_generation.push_back(new SexReprClone(*root));
+        next_generation.back()->detach();
     }
+    offspring_types.resize(tot_cell_count);
+    workers.run(tot_cell_count, produceOffspring, this);
+    // the new generation is stamped with the time writers will report it at, so types are born and go extinct in the generation that first has or lacks them
+    time++;
+    placeOffspring();
+
     bool males_extinct = true;
     bool females_extinct = true;
     for (vector<int>::iterator it = male_types.begin(); it != male_types.end(); ++it){
         CellType* curr_type = getTypeByIndex(*it);
-        males_extinct = males_extinct && curr_type->isExtinct();
+        males_extinct = males_extinct && (!curr_type || curr_type->isExtinct());
     }
     for (vector<int>::iterator it = female_types.begin(); it != female_types.end(); ++it){
         CellType* curr_type = getTypeByIndex(*it);
-        females_extinct = females_extinct && curr_type->isExtinct();
+        females_extinct = females_extinct && (!curr_type || curr_type->isExtinct());
     }
     is_extinct = males_extinct && females_extinct;
-    time = prev_time + 1;
-    recalc_birth = true;
+}
+
+void SexReprPop::produceOffspring(void *pop, int thread_id, long long begin, long long end){
+    SexReprPop *self = (SexReprPop *)pop;
+    SexReprMutation *mut_handle = (SexReprMutation *)self->mut_model;
+    std::vector<SexReprClone *>& next_generation = self->generations[1 - self->curr_generation];
+    SexReprOffspring child;
+    for (long long i=begin; i<end; i++){
+        SexReprClone *mother = self->mothers[self->mother_table.sample(*eng)];
+        SexReprClone *father = self->fathers[self->father_table.sample(*eng)];
+        mut_handle->drawOffspring(mother->getType().getIndex(), father->getType().getIndex(), mother->getBirthRate(), mother->getMutProb(), child);
+        next_generation[i]->setTraits(child.birth_rate, child.mut_prob);
+        self->offspring_types[i] = child.type_index;
+    }
+}
+
+void SexReprPop::placeOffspring(){
+    long long num_offspring = offspring_types.size();
+    // every type is emptied before the new generation is placed: hold back the phylogeny until then, so a type that lives on is never marked extinct
+    Phylogeny *tracked = phylogeny;
+    phylogeny = NULL;
+    CellType *curr_type = root;
+    while (curr_type){
+        if (uses_pool){
+            curr_type->detachClones();
+        }
+        else{
+            // first generation of this simulation: the parents were made from the input file and are not pooled
+            curr_type->deleteClones();
+        }
+        curr_type = curr_type->getNext();
+    }
+    tot_rate = 0;
+    tot_cell_count = 0;
+    uses_pool = true;
+    phylogeny = tracked;
+    
+    curr_generation = 1 - curr_generation;
+    std::vector<SexReprClone *>& generation = generations[curr_generation];
+    for (long long i=0; i<num_offspring; i++){
+        if (offspring_types[i] < 0){
+            throw "bad parent types for sexual reproduction";
+        }
+        CellType *new_type = curr_types.at(offspring_types[i]);
+        if (!new_type){
+            new_type = new CellType(offspring_types[i], NULL);
+            insertCellType(*new_type);
+        }
+        SexReprClone *new_clone = generation[i];
+        new_clone->detach();
+        new_clone->setType(*new_type);
+        new_type->insertClone(*new_clone);
+    }
+    if (phylogeny){
+        curr_type = root;
+        while (curr_type){
+            if (curr_type->getNumCells() == 0){
+                phylogeny->cellsChanged(curr_type->getIndex(), 0, time);
+            }
+            curr_type = curr_type->getNext();
+        }
+    }
 }
 
 bool SexReprPop::checkInit(){
@@ -486,46 +1080,30 @@ bool SexReprPop::checkInit(){
     return !is_extinct && CList::checkInit();
 }
 
-SexReprClone& SexReprPop::chooseReproducerVector(vector<int> possible_types){
-    uniform_real_distribution<double> runif;
-    double total_birth_vect = 0;
-    for (vector<int>::iterator it = possible_types.begin(); it != possible_types.end(); ++it){
+bool SexReprPop::buildReproducerTable(const vector<int>& possible_types, vector<SexReprClone *>& candidates, AliasTable& table){
+    candidates.clear();
+    parent_weights.clear();
+    for (vector<int>::const_iterator it = possible_types.begin(); it != possible_types.end(); ++it){
         CellType* curr_type = getTypeByIndex(*it);
         if (!curr_type || curr_type->isExtinct()){
             continue;
         }
-        total_birth_vect += curr_type->getBirthRate();
-    }
-    double ran = runif(*eng) * total_birth_vect;
-    double curr_rate = 0;
-    SexReprClone *reproducer;
-    for (vector<int>::iterator it = possible_types.begin(); it != possible_types.end(); ++it){
-        CellType* curr_type = getTypeByIndex(*it);
-        if (!curr_type || curr_type->isExtinct()){
-            continue;
-        }
-        reproducer = (SexReprClone*)curr_type->getRoot();
-        curr_rate += reproducer->getTotalBirth();
-        while (curr_rate < ran && reproducer->getNextClone()){
-            if (reproducer->getNextClone()->getType().getIndex() != reproducer->getType().getIndex()){
-                break;
-            }
-            reproducer = (SexReprClone*)reproducer->getNextClone();
-            curr_rate += reproducer->getTotalBirth();
-        }
-        if (curr_rate > ran){
-            break;
+        Clone *curr_clone = curr_type->getRoot();
+        while (curr_clone){
+            candidates.push_back((SexReprClone*)curr_clone);
+            parent_weights.push_back(curr_clone->getTotalBirth());
+            curr_clone = &(curr_clone->getNextWithinType());
         }
     }
-    return *reproducer;
+    return table.build(parent_weights);
 }
 
 SexReprClone& SexReprPop::chooseFather(){
-    return chooseReproducerVector(male_types);
+    return *fathers[father_table.sample(*eng)];
 }
 
 SexReprClone& SexReprPop::chooseMother(){
-    return chooseReproducerVector(female_types);
+    return *mothers[mother_table.sample(*eng)];
 }
 
 void SexReprPop::addMaleType(int type_index){
@@ -541,3 +1119,196 @@ void SexReprPop::addFemaleType(int type_index){
     }
     return;
 }
+
+ReplayPop::ReplayPop() : CList(){
+    finished = false;
+    ended_extinct = false;
+    has_pending = false;
+}
+
+bool ReplayPop::handle_line(vector<string>& parsed_line){
+    CList::handle_line(parsed_line);
+    return true;
+}
+
+bool ReplayPop::open(const string& filename){
+    if (!reader.open(filename)){
+        return false;
+    }
+    // the recorded typespace, which the input file may not match
+    max_types = reader.getMaxTypes() + 1;
+    CList::refreshSim();
+    mut_model = &replay_mutation;
+    replay_mutation.reset();
+    key_clones.clear();
+    pending.clear();
+    has_pending = false;
+    finished = false;
+    ended_extinct = false;
+    EventRecord record;
+    while (reader.next(record)){
+        if (record.kind == EventLog::BEGIN){
+            time = record.time;
+            checkEnd();
+            return true;
+        }
+        if (!apply(record)){
+            break;
+        }
+    }
+    reader.close();
+    return false;
+}
+
+bool ReplayPop::apply(const EventRecord& record){
+    switch (record.kind){
+        case EventLog::TYPE:{
+            if (record.type_index < 0 || record.type_index >= max_types || curr_types[record.type_index]){
+                return false;
+            }
+            CellType *parent = hasCellType(record.parent) ? getTypeByIndex(record.parent) : NULL;
+            CellType *added_type = new CellType(record.type_index, parent);
+            if (record.is_root){
+                addRootType(*added_type);
+            }
+            insertCellType(*added_type);
+            if (parent){
+                parent->addChild(*added_type);
+            }
+            return true;
+        }
+        case EventLog::KEY:
+            key_clones.push_back(NULL);
+            return true;
+        case EventLog::BIRTH:
+        case EventLog::ADD:{
+            if (!hasCellType(record.type_index)){
+                return false;
+            }
+            Clone *clone = key_clones[record.key];
+            if (clone){
+                clone->addCells(record.num_cells);
+                return true;
+            }
+            clone = new SimpleClone(*getTypeByIndex(record.type_index), record.birth_rate, 0, record.num_cells);
+            getTypeByIndex(record.type_index)->insertClone(*clone);
+            key_clones[record.key] = clone;
+            return true;
+        }
+        case EventLog::DEATH:{
+            Clone *clone = key_clones[record.key];
+            if (!clone){
+                return false;
+            }
+            if (clone->isSingleCell()){
+                delete clone;
+                key_clones[record.key] = NULL;
+            }
+            else{
+                clone->removeOneCell();
+            }
+            return true;
+        }
+        case EventLog::REMOVE:{
+            Clone *clone = key_clones[record.key];
+            if (!clone || clone->getCellCount() < -record.num_cells){
+                return false;
+            }
+            if (clone->getCellCount() == -record.num_cells){
+                // the destructor removes the last cell
+                clone->addCells(record.num_cells + 1);
+                delete clone;
+                key_clones[record.key] = NULL;
+            }
+            else{
+                clone->addCells(record.num_cells);
+            }
+            return true;
+        }
+        case EventLog::DETACH:{
+            if (!hasCellType(record.type_index)){
+                return false;
+            }
+            // leave the cells as CellType::detachClones does, so a log recorded from the replay matches the original
+            for (size_t i=0; i<key_clones.size(); i++){
+                Clone *clone = key_clones[i];
+                if (clone && clone->getType().getIndex() == record.type_index){
+                    tot_rate -= clone->getBirthRate() * clone->getCellCount();
+                    tot_cell_count -= clone->getCellCount();
+                    clone->detach();
+                    delete clone;
+                    key_clones[i] = NULL;
+                }
+            }
+            getTypeByIndex(record.type_index)->detachClones();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ReplayPop::checkEnd(){
+    int kind = reader.peekKind();
+    EventRecord record;
+    if (kind == EventLog::END && reader.next(record)){
+        finished = true;
+        ended_extinct = record.extinct;
+    }
+    else if (kind == 0){
+        // the log was cut short: end here, judging extinction from the population
+        finished = true;
+        ended_extinct = CList::isExtinct();
+    }
+}
+
+bool ReplayPop::readAhead(){
+    EventRecord record;
+    while (reader.next(record)){
+        if (record.kind == EventLog::STEP){
+            pending_step = record;
+            has_pending = true;
+            return true;
+        }
+        pending.push_back(record);
+    }
+    return false;
+}
+
+double ReplayPop::nextEventTime(){
+    if (!has_pending && !readAhead()){
+        return time;
+    }
+    return pending_step.time;
+}
+
+void ReplayPop::advance(){
+    mut_model->reset();
+    bool has_step = has_pending || readAhead();
+    has_pending = false;
+    // the records of a step happened at its time, as the types they create are stamped with it
+    if (has_step){
+        time = pending_step.time;
+    }
+    bool applied = true;
+    for (size_t i=0; i<pending.size() && applied; i++){
+        applied = apply(pending[i]);
+    }
+    pending.clear();
+    if (!has_step || !applied){
+        finished = true;
+        ended_extinct = CList::isExtinct();
+        return;
+    }
+    EventRecord& record = pending_step;
+    prev_fit = record.mother_birth;
+    new_fit = record.daughter_birth;
+    if (record.has_mutation && hasCellType(record.type_index)){
+        CellType *mutant_type = getTypeByIndex(record.type_index);
+        if (hasCellType(record.parent)){
+            mutant_type->setParent(getTypeByIndex(record.parent));
+        }
+        replay_mutation.setMutant(*mutant_type, new_fit);
+        new_type = record.type_index;
+    }
+    checkEnd();
+}
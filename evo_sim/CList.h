@@ -13,8 +13,17 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <queue>
+#include <map>
+#include <tuple>
 #include "Clone.h"
 #include "main.h"
+#include "AliasTable.h"
+#include "MutationHandler.h"
+#include "DiffusionFirstPassage.h"
+#include "FitnessHistogram.h"
+#include "EventLog.h"
+#include "Phylogeny.h"
 
 using namespace std;
 
@@ -45,8 +54,36 @@ protected:
     
     long long tot_cell_count;
     MutationHandler *mut_model;
+    // waiting time and rates of the next event, when drawn ahead of advance() by nextEventTime()
+    bool has_next_event;
+    double next_time;
+    double next_birth;
+    double next_death;
     
     virtual Clone& chooseReproducer();
+    // called whenever type gains (num_cells > 0) or loses cells
+    virtual void typeCountChanged(CellType& type, long long num_cells){};
+    // histograms updated at every birth and death. empty unless a writer tracks one.
+    std::vector<FitnessHistogram *> fitness_histograms;
+    // records every change to the population while a writer is logging events, otherwise NULL
+    EventLog *event_log;
+    // records the tree of types while a writer tracks it, otherwise NULL
+    Phylogeny *phylogeny;
+    // called whenever num_cells cells with birth rate b are born (num_cells > 0) or die
+    void cellsChanged(int type_index, double b, long long num_cells){
+        if (!fitness_histograms.empty()){
+            updateHistograms(type_index, b, num_cells);
+        }
+        if (event_log){
+            event_log->cellsChanged(type_index, b, num_cells);
+        }
+        if (phylogeny){
+            phylogeny->cellsChanged(type_index, curr_types[type_index]->getNumCells(), time);
+        }
+    }
+    void updateHistograms(int type_index, double b, long long num_cells);
+    // called when a type's clones are detached without their cells dying one by one
+    void typeDetached(int type_index);
     Clone& chooseDead();
     Clone& chooseDeadVar(double total_death);
     void deleteList();
@@ -58,7 +95,7 @@ protected:
      @param b PER CELL birth rate of new cells to be added
      @param num_cells number of cells to be added
      */
-    void addCells(int num_cells, double b);
+    void addCells(long long num_cells, double b);
     
     /* removes EXACTLY ONE cell from the population
      */
@@ -88,6 +125,11 @@ public:
      */
     virtual void advance();
     
+    /* time the next call to advance() will move the simulation to, so writers can sample the current state up to then.
+     drawing it ahead does not change the simulation: advance() uses the same draw.
+     */
+    virtual double nextEventTime();
+    
     double getTotalBirth();
     
     /* get the index of a new cell type that doesn't conflict with the current typespace.
@@ -144,11 +186,19 @@ public:
     std::vector<CellType *>& getRootTypes(){
         return root_types;
     }
+    // @return first of every type in the simulation, including extinct ones, which are linked by CellType::getNext
+    CellType* getFirstType(){
+        return root;
+    }
     virtual void refreshSim();
     
     virtual bool isExtinct(){
         return tot_cell_count == 0;
     }
+    // @return true when the population cannot advance for a reason other than extinction
+    virtual bool isFinished(){
+        return false;
+    }
     
     int newestType();
     
@@ -156,9 +206,34 @@ public:
         return num_types == max_types;
     }
     
-    void walkTypesAndWrite(ofstream& outfile, CellType& root);
+    void walkTypesAndWrite(ostream& outfile, CellType& root);
+    
+    /* keeps a histogram up to date with every birth and death until untracked. the histogram is filled with the current population first.
+     */
+    void trackFitness(FitnessHistogram& histogram);
+    void untrackFitness(FitnessHistogram& histogram);
+    // recounts the cells of the histogram's type(s) from scratch
+    void fillHistogram(FitnessHistogram& histogram);
+    
+    /* writes the current population to log, then records every change to it until stopLog.
+     */
+    void startLog(EventLog& log);
+    void stopLog(){
+        event_log = NULL;
+    }
+    
+    /* records every type in phylogeny, starting from the current population, until untracked.
+     */
+    void trackPhylogeny(Phylogeny& new_phylogeny);
+    void untrackPhylogeny(){
+        phylogeny = NULL;
+    }
     
     virtual bool handle_line(vector<string>& parsed_line);
+    // @return storage for Diffusion1DClone state, or NULL if this population does not support them
+    virtual Diffusion1DBatch* getDiffusionBatch(){
+        return NULL;
+    }
     
     bool read_clones(ifstream& infile);
     
@@ -175,20 +250,128 @@ public:
 };
 
 class MoranPop: public CList{
+    /* optionally frequency dependent: with a payoff matrix A, a cell of type i has fitness 1 - w + w*pi_i, where pi_i is its average payoff against the rest of the population.
+     the payoff sums S_i = sum_j A_ij n_j are updated by one column of A whenever a type gains or loses cells, so choosing a reproducer costs O(types) and clone birth rates are never changed.
+     types beyond the matrix get and give no payoff.
+     */
+private:
+    bool has_payoff;
+    int num_payoff_types;
+    // selection strength w
+    double selection;
+    // row-major num_payoff_types x num_payoff_types
+    vector<double> payoffs;
+    vector<double> payoff_sums;
+    // weights of the types in list order, reused between events
+    vector<double> type_weights;
+    
+    bool readPayoffs(string filename);
+    void recomputePayoffSums();
+    // @return scale applied to the birth rates of every cell of type
+    double getPayoffFitness(CellType& type);
+protected:
+    Clone& chooseReproducer();
+    void typeCountChanged(CellType& type, long long num_cells);
 public:
     MoranPop();
     virtual void advance();
+    double nextEventTime(){
+        return time + 1;
+    }
+    bool handle_line(vector<string>& parsed_line);
+    void refreshSim();
 };
 
 class UpdateAllPop: public CList{
 private:
     double timestep_length;
+    // state of every Diffusion1DClone in the population. when it holds every cell, a timestep runs as one batched kernel over the arrays.
+    Diffusion1DBatch diffusion_batch;
+    bool uses_batch;
+    // clones to update this step when not every cell is in diffusion_batch
+    std::vector<Clone *> update_clones;
+    // clone updates are independent, so workers update disjoint ranges and flag reproducers/dead into their own lists
+    WorkerTeam workers;
+    std::vector<std::vector<Clone *> > thread_reproducers;
+    std::vector<std::vector<Clone *> > thread_dead;
+    std::vector<Clone *> reproducers;
+    std::vector<Clone *> dead;
+    static void updateRange(void *pop, int thread_id, long long begin, long long end);
+    // appends the per-thread lists in thread order, so the structural changes do not depend on scheduling
+    void mergeFlagged();
+    /* density mode: a CellType whose Diffusion1DClones reach density_on cells is stored as a single Diffusion1DDensityClone,
+     and turned back into individual clones once it has density_off cells or fewer. disabled while density_on is 0.
+     */
+    long long density_on;
+    long long density_off;
+    int density_bins;
+    // active densities in creation order, and the density of each type index (NULL if none)
+    std::vector<Diffusion1DDensityClone *> densities;
+    std::vector<Diffusion1DDensityClone *> type_densities;
+    // Diffusion1DClones of each type index outside any density, counted at each switch
+    std::vector<long long> batch_type_cells;
+    long long countDensityCells();
+    void switchRepresentations();
+    void condense(CellType& type);
+    void absorbClones(CellType& type, Diffusion1DDensityClone& density);
+    void removeDensity(Diffusion1DDensityClone& density);
+    static void stepDensities(void *pop, int thread_id, long long begin, long long end);
 protected:
     bool checkInit();
 public:
     UpdateAllPop();
     void advance();
+    double nextEventTime(){
+        return time + timestep_length;
+    }
+    void refreshSim();
     bool handle_line(vector<string>& parsed_line);
+    Diffusion1DBatch* getDiffusionBatch(){
+        return &diffusion_batch;
+    }
+};
+
+class DiffusionEventPop: public CList{
+    /* continuous-time engine for populations of Diffusion1DClones. drift and diffusion are read as the drift and volatility of a Brownian motion in continuous time.
+     every clone has exactly one pending event: the earliest of its threshold crossing, death and division, each sampled exactly. events are processed in time order,
+     so the cost of a simulation scales with the number of events rather than with the number of clones times the number of timesteps.
+     */
+private:
+    struct DiffusionEvent{
+        double time;
+        // time at which the clone's position was last known
+        double start;
+        Diffusion1DClone *clone;
+        bool divides;
+        bool operator>(const DiffusionEvent& other) const{
+            return time > other.time;
+        }
+    };
+    Diffusion1DBatch clone_state;
+    std::priority_queue<DiffusionEvent, std::vector<DiffusionEvent>, std::greater<DiffusionEvent> > events;
+    bool is_scheduled;
+    // samplers are keyed by (drift, diffusion, threshold). clones inherit these exactly, so there are few of them, and their series roots are kept across simulations.
+    std::map<std::tuple<double, double, double>, DiffusionFirstPassage *> passage_samplers;
+    DiffusionFirstPassage& getSampler(Diffusion1DClone& clone);
+    // samples the next event of a clone whose position is known at time now
+    void schedule(Diffusion1DClone& clone, double now);
+    void scheduleAll();
+public:
+    DiffusionEventPop();
+    ~DiffusionEventPop();
+    void advance();
+    double nextEventTime();
+    void refreshSim();
+    // true once no clone has an event left, as when every remaining clone has no birth or death and never reaches its threshold
+    bool isFinished(){
+        if (!is_scheduled){
+            scheduleAll();
+        }
+        return events.empty();
+    }
+    Diffusion1DBatch* getDiffusionBatch(){
+        return &clone_state;
+    }
 };
 
 class SexReprPop: public CList{
@@ -196,14 +379,41 @@ private:
     std::vector<int> male_types;
     std::vector<int> female_types;
     bool is_extinct;
+    // parent weights are frozen within a generation, so candidate parents and their alias tables are built once per generation
+    std::vector<SexReprClone *> mothers;
+    std::vector<SexReprClone *> fathers;
+    AliasTable mother_table;
+    AliasTable father_table;
+    std::vector<double> parent_weights;
+    // offspring are conditionally independent given the parents, so workers fill disjoint ranges of the next generation
+    WorkerTeam workers;
+    /* two preallocated generations of clones that swap roles every generation. the current one is linked into the CellTypes;
+     offspring are written into the other, which is then linked in its place. the clone objects are reused across generations and simulations.
+     */
+    std::vector<SexReprClone *> generations[2];
+    int curr_generation;
+    // type id of each offspring in the next generation
+    std::vector<int> offspring_types;
+    // false until the clones made from the input file have been replaced by pooled clones
+    bool uses_pool;
+    static void produceOffspring(void *pop, int thread_id, long long begin, long long end);
+    // replaces the current generation with the next one, rebuilding the type totals in one pass
+    void placeOffspring();
 protected:
-    SexReprClone& chooseReproducerVector(vector<int> possible_types);
+    /* collects every clone of the given types and builds an alias table over their total birth rates.
+     @return false iff no clone of the given types can reproduce
+     */
+    bool buildReproducerTable(const vector<int>& possible_types, vector<SexReprClone *>& candidates, AliasTable& table);
     SexReprClone& chooseMother();
     SexReprClone& chooseFather();
     bool checkInit();
 public:
     SexReprPop();
+    ~SexReprPop();
     void advance();
+    double nextEventTime(){
+        return time + 1;
+    }
     bool isExtinct(){return is_extinct;};
     void addMaleType(int type_index);
     void addFemaleType(int type_index);
@@ -211,4 +421,49 @@ public:
     bool handle_line(vector<string>& parsed_line);
 };
 
+class ReplayPop: public CList{
+    /* replays an event log written by EventLogWriter instead of simulating. each call to advance applies the records of one recorded call,
+     so writers see the same sequence of populations as they would have in the recorded simulation.
+     clones are rebuilt one per type and birth rate, so writers that list clones may see them merged or in a different order.
+     */
+private:
+    EventLogReader reader;
+    ReplayMutation replay_mutation;
+    // clone holding the cells of each key of the log, NULL while it has none
+    std::vector<Clone *> key_clones;
+    bool finished;
+    bool ended_extinct;
+    // lets the input file's Diffusion1D clones be read, although the log replaces them
+    Diffusion1DBatch clone_state;
+    // records of the next recorded call to advance, read ahead by nextEventTime
+    std::vector<EventRecord> pending;
+    EventRecord pending_step;
+    bool has_pending;
+    // @return false if the log ends before the next STEP record
+    bool readAhead();
+    // @return false if the record does not fit the population built so far
+    bool apply(const EventRecord& record);
+    // reads the END record if it comes next, and marks the replay finished at the end of the log
+    void checkEnd();
+public:
+    ReplayPop();
+    /* replaces the population with the initial population of a log.
+     @return false if the log could not be read
+     */
+    bool open(const string& filename);
+    void advance();
+    double nextEventTime();
+    // parameters of the recorded model are accepted and ignored
+    bool handle_line(vector<string>& parsed_line);
+    bool isExtinct(){
+        return finished ? ended_extinct : CList::isExtinct();
+    }
+    bool isFinished(){
+        return finished;
+    }
+    Diffusion1DBatch* getDiffusionBatch(){
+        return &clone_state;
+    }
+};
+
 #endif /* clist_h */
@@ -16,7 +16,10 @@
 #include <cstdlib>
 #include <sstream>
 #include <fstream>
+#include <cmath>
+#include <algorithm>
 #include "MutationHandler.h"
+#include "DistributionStore.h"
 using namespace std;
 
 void Clone::removeOneCell(){
@@ -25,6 +28,9 @@ void Clone::removeOneCell(){
 }
 
 Clone::~Clone(){
+    if (!cell_type){
+        return;
+    }
     cell_type->subtractOneCell(birth_rate);
     if (!prev_node){
         cell_type->setRoot(*next_node);
@@ -67,7 +73,7 @@ double Clone::getDeathRate(){
     return cell_type->getDeathRate();
 }
 
-SimpleClone::SimpleClone(CellType& type, double b, double mut, int num_cells) : Clone(type, mut){
+SimpleClone::SimpleClone(CellType& type, double b, double mut, long long num_cells) : Clone(type, mut){
     birth_rate = b;
     cell_count = num_cells;
 }
@@ -101,12 +107,10 @@ HeritableClone::HeritableClone(CellType& type, bool mult) : StochClone(type, mul
 
 HerResetClone::HerResetClone(CellType& type, bool mult) : HeritableClone(type, mult){
     num_gen_persist = 0;
-    active_diff = queue<double>();
 }
 
 HerResetExpClone::HerResetExpClone(CellType& type, bool mult) : HerPoissonClone(type, mult){
     time_constant = 0;
-    active_diff = vector<double>();
 }
 
 HerPoissonClone::HerPoissonClone(CellType& type, bool mult) : HeritableClone(type, mult){
@@ -115,7 +119,6 @@ HerPoissonClone::HerPoissonClone(CellType& type, bool mult) : HeritableClone(typ
 
 HerResetEmpiricClone::HerResetEmpiricClone(CellType& type, bool mult) : HerEmpiricClone(type, mult){
     num_gen_persist = 0;
-    active_diff = queue<double>();
 }
 
 TypeEmpiricClone::TypeEmpiricClone(CellType& type, bool mult) : EmpiricalClone(type, mult){
@@ -190,18 +193,18 @@ HeritableClone::HeritableClone(CellType& type, double mu, double sig, double mut
     dist_type = dist;
 }
 
-HerResetClone::HerResetClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, queue<double>& diffs, string dist) : HeritableClone(type, mu, sig, mut, offset, mult, dist){
+HerResetClone::HerResetClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, AlterationHistory& diffs, string dist) : HeritableClone(type, mu, sig, mut, offset, mult, dist){
     num_gen_persist = num_gen;
-    active_diff = queue<double>(diffs);
+    active_diff = diffs;
     if (!HerResetClone::checkRep()){
         throw "mismanaged reset queue";
     }
 }
 
-HerResetExpClone::HerResetExpClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, double time, double accum, vector<double>& diffs, string dist) : HerPoissonClone(type, mu, sig, mut, offset, mult, accum, dist){
+HerResetExpClone::HerResetExpClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, double time, double accum, SharedAlterationHistory& diffs, string dist) : HerPoissonClone(type, mu, sig, mut, offset, mult, accum, dist){
     time_constant = time;
     accum_rate = accum;
-    active_diff = vector<double>(diffs);
+    active_diff = diffs;
     if (!HerResetExpClone::checkRep()){
         throw "bad time constant for HerResetExp";
     }
@@ -211,21 +214,21 @@ HerPoissonClone::HerPoissonClone(CellType& type, double mu, double sig, double m
     accum_rate = accum;
 }
 
-HerResetEmpiricClone::HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, queue<double>& diffs) : HerEmpiricClone(type, mu, sig, mut, offset, mult){
+HerResetEmpiricClone::HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, AlterationHistory& diffs) : HerEmpiricClone(type, mu, sig, mut, offset, mult){
     num_gen_persist = num_gen;
-    active_diff = queue<double>(diffs);
+    active_diff = diffs;
     if (!HerResetEmpiricClone::checkRep()){
         throw "mismanaged reset queue";
     }
 }
 
-HerResetClone::HerResetClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, queue<double>& diffs, string dist) : HeritableClone(type, mult){
+HerResetClone::HerResetClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, AlterationHistory& diffs, string dist) : HeritableClone(type, mult){
     mean = mu;
     var = sig;
     mut_prob = mut;
     birth_rate = mu;
     num_gen_persist = num_gen;
-    active_diff = queue<double>(diffs);
+    active_diff = diffs;
     dist_type = dist;
     cell_count = 1;
     if (!HerResetClone::checkRep()){
@@ -233,14 +236,14 @@ HerResetClone::HerResetClone(CellType& type, double mu, double sig, double mut,
     }
 }
 
-HerResetExpClone::HerResetExpClone(CellType& type, double mu, double sig, double mut, bool mult, double time, double accum, vector<double>& diffs, string dist) : HerPoissonClone(type, mult){
+HerResetExpClone::HerResetExpClone(CellType& type, double mu, double sig, double mut, bool mult, double time, double accum, SharedAlterationHistory& diffs, string dist) : HerPoissonClone(type, mult){
     mean = mu;
     var = sig;
     mut_prob = mut;
     birth_rate = mu;
     accum_rate = accum;
     time_constant = time;
-    active_diff = vector<double>(diffs);
+    active_diff = diffs;
     dist_type = dist;
     cell_count = 1;
     if (!HerResetExpClone::checkRep()){
@@ -258,13 +261,13 @@ HerPoissonClone::HerPoissonClone(CellType& type, double mu, double sig, double m
     cell_count = 1;
 }
 
-HerResetEmpiricClone::HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, queue<double>& diffs) : HerEmpiricClone(type, mult){
+HerResetEmpiricClone::HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, AlterationHistory& diffs) : HerEmpiricClone(type, mult){
     mean = mu;
     var = sig;
     mut_prob = mut;
     birth_rate = mu;
     num_gen_persist = num_gen;
-    active_diff = queue<double>(diffs);
+    active_diff = diffs;
     cell_count = 1;
     if (!HerResetEmpiricClone::checkRep()){
         throw "mismanaged reset queue";
@@ -306,7 +309,7 @@ TypeEmpiricClone::TypeEmpiricClone(CellType& type, double mu, double sig, double
     cell_count = 1;
 }
 
-void Clone::addCells(int num_cells){
+void Clone::addCells(long long num_cells){
     cell_count+=num_cells;
     cell_type->addCells(num_cells, birth_rate);
 }
@@ -455,43 +458,43 @@ double HerResetClone::reset(){
     else{
         birth_rate = birth_rate - to_remove;
     }
-    active_diff.pop();
     double offset = setNewBirth(birth_rate, var);
-    active_diff.push(offset);
+    active_diff.replaceOldest(offset);
     return offset;
 }
 
-void HerResetExpClone::reset(){
-
-    
-    double to_remove;
-    vector<int> index_to_remove = vector<int>();
-    uniform_real_distribution<double> runif;
-    
-    if (is_mult){
-        to_remove = 1;
-        for (int i=0; i<active_diff.size(); i++){
-            if (runif(*eng) < time_constant){
-                to_remove *= active_diff.at(i);
-                index_to_remove.push_back(i);
-            }
-        }
+int HerResetExpClone::nextExpiry(){
+    if (time_constant >= 1){
+        return 0;
     }
-    else{
-        to_remove = 0;
-        for (int i=0; i<active_diff.size(); i++){
-            if (runif(*eng) < time_constant){
-                to_remove += active_diff.at(i);
-                index_to_remove.push_back(i);
-            }
-        }
+    uniform_real_distribution<double> runif;
+    // number of surviving alterations before the next expiry is geometric
+    double gap = log(1 - runif(*eng))/log1p(-time_constant);
+    if (gap >= active_diff.size()){
+        return int(active_diff.size());
     }
-    
+    return int(gap);
+}
+
+void HerResetExpClone::reset(){
     removeOneCell();
-    if (index_to_remove.size()==0){
+    if (active_diff.size() == 0 || time_constant <= 0){
         return;
     }
-
+    
+    // draw only once per expired alteration. after a removal the next alteration takes its index.
+    double to_remove = is_mult ? 1 : 0;
+    int index = nextExpiry();
+    while (index < active_diff.size()){
+        double alteration = active_diff.removeAt(index);
+        if (is_mult){
+            to_remove *= alteration;
+        }
+        else{
+            to_remove += alteration;
+        }
+        index += nextExpiry();
+    }
     
     if (is_mult){
         birth_rate = birth_rate/to_remove;
@@ -499,15 +502,11 @@ void HerResetExpClone::reset(){
     else{
         birth_rate = birth_rate - to_remove;
     }
-    
-    for (int i=index_to_remove.size()-1; i>=0;i--){
-        active_diff.erase(active_diff.begin() + i);
-    }
 }
 
 double HerResetExpClone::add_alteration(){
     double offset = setNewBirth(birth_rate, var);
-    active_diff.push_back(offset);
+    active_diff.push(offset);
     return offset;
 }
 
@@ -544,9 +543,8 @@ double HerResetEmpiricClone::reset(){
     else{
         birth_rate = birth_rate - to_remove;
     }
-    active_diff.pop();
     double offset = setNewBirth(birth_rate, var);
-    active_diff.push(offset);
+    active_diff.replaceOldest(offset);
     return offset;
 }
 
@@ -826,6 +824,10 @@ bool HerResetClone::readLine(vector<string>& parsed_line){
         double death = stod(parsed_line[7]);
         cell_type->setDeathRate(death);
     }
+    if (num_gen_persist < 1){
+        return false;
+    }
+    active_diff.setCapacity(num_gen_persist);
     double offset = setNewBirth(mean, var);
     for (int i=0; i<num_gen_persist-1; i++){
         if (is_mult){
@@ -909,6 +911,10 @@ bool HerResetEmpiricClone::readLine(vector<string>& parsed_line){
         double death = stod(parsed_line[6]);
         cell_type->setDeathRate(death);
     }
+    if (num_gen_persist < 1){
+        return false;
+    }
+    active_diff.setCapacity(num_gen_persist);
     double offset = setNewBirth(mean, var);
     for (int i=0; i<num_gen_persist-1; i++){
         active_diff.push(1);
@@ -945,25 +951,7 @@ bool EmpiricalClone::readDist(string filename){
     if (cell_type->hasDist()){
         return true;
     }
-    ifstream infile;
-    infile.open(filename);
-    if (!infile.is_open()){
-        return false;
-    }
-    string line;
-    while (getline(infile, line)){
-        std::stringstream ss;
-        string tok;
-        ss.str(line);
-        try{
-            while (getline(ss, tok, '\t')){
-                cell_type->addDistPoint(stod(tok));
-            }
-        }
-        catch(...){
-            return false;
-        }
-    }
+    cell_type->setDist(DistributionStore::load(filename));
     return cell_type->hasDist();
 }
 
@@ -979,15 +967,24 @@ UpdateClone::UpdateClone(CellType& type) : Clone(type){
 }
 
 Diffusion1DClone::Diffusion1DClone(CellType& type) : UpdateClone(type){
-    threshold = 0;
-    curr_pos = 0;
-    diffusion = 0;
-    drift = 0;
+    batch = type.getPopulation().getDiffusionBatch();
+    if (!batch){
+        throw "Diffusion1DClone requires a population that stores diffusion state";
+    }
+    slot = batch->add(this, 0, getDeathRate());
+}
+
+Diffusion1DClone::~Diffusion1DClone(){
+    Diffusion1DClone *moved = batch->remove(slot);
+    if (moved){
+        moved->setSlot(slot);
+    }
 }
 
 void Diffusion1DClone::update(double t){
     uniform_real_distribution<double> runif;
-    normal_distribution<double> rnorm(t*drift, t*diffusion);
+    normal_distribution<double> rnorm(t*getDrift(), t*getDiffusion());
+    double& curr_pos = batch->position(slot);
     if (curr_pos < 0){
         curr_pos -= rnorm(*eng);
     }
@@ -996,7 +993,7 @@ void Diffusion1DClone::update(double t){
     }
     double death_prob = t * getDeathRate();
     double birth_prob = t * birth_rate;
-    if (curr_pos > threshold || curr_pos < -threshold || runif(*eng) < death_prob){
+    if (curr_pos > getThreshold() || curr_pos < -getThreshold() || runif(*eng) < death_prob){
         is_dead = true;
     }
     else if (runif(*eng) < birth_prob){
@@ -1009,42 +1006,178 @@ bool Diffusion1DClone::readLine(vector<string>& parsed_line){
     cell_count = 1;
     try{
         birth_rate =stod(parsed_line[1]);
-        drift =stod(parsed_line[2]);
-        diffusion = stod(parsed_line[3]);
-        threshold =stod(parsed_line[4]);
+        batch->driftAt(slot) =stod(parsed_line[2]);
+        batch->diffusionAt(slot) = stod(parsed_line[3]);
+        batch->thresholdAt(slot) =stod(parsed_line[4]);
         mut_prob = stod(parsed_line[6]);
-        curr_pos = stod(parsed_line[5]);
+        batch->position(slot) = stod(parsed_line[5]);
         
     }
     catch (...){
         return false;
     }
+    batch->birthAt(slot) = birth_rate;
+    // the type's death rate is final once its clone line has been read
+    batch->deathAt(slot) = getDeathRate();
     return Diffusion1DClone::checkRep();
 }
 
 void Diffusion1DClone::reproduce(){
+    divide();
+    has_reproduced = false;
+}
+
+Diffusion1DClone* Diffusion1DClone::divide(){
     uniform_real_distribution<double> runif;
+    Diffusion1DClone *new_node;
     if (runif(*eng) < mut_prob){
         MutationHandler& mut_handle = cell_type->getMutHandler();
         mut_handle.generateMutant(*cell_type, birth_rate, mut_prob);
-        Diffusion1DClone *new_node = new Diffusion1DClone(mut_handle.getNewType(), mut_handle.getNewBirthRate(), mut_handle.getNewMutProb(), drift, diffusion, threshold, curr_pos);
+        new_node = new Diffusion1DClone(mut_handle.getNewType(), mut_handle.getNewBirthRate(), mut_handle.getNewMutProb(), getDrift(), getDiffusion(), getThreshold(), getPosition());
         mut_handle.getNewType().insertClone(*new_node);
     }
     else{
-        Diffusion1DClone *new_node = new Diffusion1DClone(*cell_type, birth_rate, mut_prob, drift, diffusion, threshold, curr_pos);
+        new_node = new Diffusion1DClone(*cell_type, birth_rate, mut_prob, getDrift(), getDiffusion(), getThreshold(), getPosition());
         cell_type->insertClone(*new_node);
     }
-    has_reproduced = false;
+    return new_node;
 }
 
 Diffusion1DClone::Diffusion1DClone(CellType& type, double b, double mu, double dr, double diff, double thresh, double pos) : UpdateClone(type){
     birth_rate = b;
-    threshold = thresh;
-    curr_pos = pos;
-    diffusion = diff;
-    drift = dr;
     mut_prob = mu;
     cell_count = 1;
+    batch = type.getPopulation().getDiffusionBatch();
+    if (!batch){
+        throw "Diffusion1DClone requires a population that stores diffusion state";
+    }
+    slot = batch->add(this, b, getDeathRate());
+    batch->thresholdAt(slot) = thresh;
+    batch->position(slot) = pos;
+    batch->diffusionAt(slot) = diff;
+    batch->driftAt(slot) = dr;
+}
+
+Diffusion1DDensityClone::Diffusion1DDensityClone(Diffusion1DClone& model, int num_bins) : UpdateClone(model.getType()){
+    birth_rate = model.getBirthRate();
+    mut_prob = model.getMutProb();
+    drift = model.getDrift();
+    diffusion = model.getDiffusion();
+    threshold = model.getThreshold();
+    death_rate = model.getDeathRate();
+    bin_width = threshold/num_bins;
+    bins.assign(num_bins, 0);
+    new_count = 0;
+}
+
+int Diffusion1DDensityClone::binOf(double pos){
+    int bin = int(fabs(pos)/bin_width);
+    if (bin >= int(bins.size())){
+        bin = int(bins.size()) - 1;
+    }
+    return bin;
+}
+
+bool Diffusion1DDensityClone::matches(Diffusion1DClone& clone){
+    return (clone.getBirthRate() == birth_rate && clone.getMutProb() == mut_prob && clone.getDrift() == drift && clone.getDiffusion() == diffusion && clone.getThreshold() == threshold);
+}
+
+void Diffusion1DDensityClone::absorb(Diffusion1DClone& clone){
+    bins[binOf(clone.getPosition())]++;
+    addCells(1);
+}
+
+void Diffusion1DDensityClone::step(double t){
+    int num_bins = int(bins.size());
+    double mean = t * drift;
+    double var = (t * diffusion) * (t * diffusion);
+    // split the step so that no bin sends out more than all of its cells
+    double hop = (var + mean * mean)/(bin_width * bin_width);
+    double advect = mean/bin_width;
+    int num_substeps = max(1, int(ceil(max(hop, advect))));
+    double sub_mean = mean/num_substeps;
+    double sub_var = var/num_substeps;
+    double sub_hop = (sub_var + sub_mean * sub_mean)/(bin_width * bin_width);
+    double sub_advect = sub_mean/bin_width;
+    // p_right - p_left matches the mean step; p_right + p_left matches the second moment unless the bins are too coarse, in which case the scheme is upwind
+    double p_left = max(0.0, (sub_hop - sub_advect)/2);
+    double p_right = min(1.0 - p_left, p_left + sub_advect);
+    double p_right_given_not_left = (p_left < 1) ? p_right/(1 - p_left) : 0;
+
+    for (int k=0; k<num_substeps; k++){
+        moved.assign(num_bins, 0);
+        for (int i=0; i<num_bins; i++){
+            long long count = bins[i];
+            if (count == 0){
+                continue;
+            }
+            binomial_distribution<long long> left_draw(count, p_left);
+            long long left = left_draw(*eng);
+            binomial_distribution<long long> right_draw(count - left, p_right_given_not_left);
+            long long right = right_draw(*eng);
+            moved[i] += count - left - right;
+            // bin 0 reflects; cells leaving the last bin have crossed the threshold
+            moved[(i > 0) ? i - 1 : 0] += left;
+            if (i < num_bins - 1){
+                moved[i + 1] += right;
+            }
+        }
+        bins.swap(moved);
+    }
+
+    uniform_real_distribution<double> runif;
+    double death_prob = min(1.0, t * death_rate);
+    double birth_prob = min(1.0, t * birth_rate);
+    mutant_positions.clear();
+    new_count = 0;
+    for (int i=0; i<num_bins; i++){
+        long long count = bins[i];
+        if (count == 0){
+            continue;
+        }
+        binomial_distribution<long long> death_draw(count, death_prob);
+        long long died = death_draw(*eng);
+        binomial_distribution<long long> birth_draw(count - died, birth_prob);
+        long long born = birth_draw(*eng);
+        long long mutants = 0;
+        if (born > 0 && mut_prob > 0){
+            binomial_distribution<long long> mutant_draw(born, mut_prob);
+            mutants = mutant_draw(*eng);
+        }
+        for (long long j=0; j<mutants; j++){
+            mutant_positions.push_back((i + runif(*eng)) * bin_width);
+        }
+        bins[i] = count - died + born - mutants;
+        new_count += bins[i];
+    }
+}
+
+bool Diffusion1DDensityClone::applyStep(){
+    MutationHandler& mut_handle = cell_type->getMutHandler();
+    for (vector<double>::iterator it = mutant_positions.begin(); it != mutant_positions.end(); ++it){
+        mut_handle.generateMutant(*cell_type, birth_rate, mut_prob);
+        Diffusion1DClone *new_node = new Diffusion1DClone(mut_handle.getNewType(), mut_handle.getNewBirthRate(), mut_handle.getNewMutProb(), drift, diffusion, threshold, *it);
+        mut_handle.getNewType().insertClone(*new_node);
+    }
+    mutant_positions.clear();
+    if (new_count == 0){
+        addCells(1 - cell_count);
+        return false;
+    }
+    addCells(new_count - cell_count);
+    return true;
+}
+
+void Diffusion1DDensityClone::dissolve(){
+    uniform_real_distribution<double> runif;
+    for (int i=0; i<int(bins.size()); i++){
+        for (long long j=0; j<bins[i]; j++){
+            Diffusion1DClone *new_node = new Diffusion1DClone(*cell_type, birth_rate, mut_prob, drift, diffusion, threshold, (i + runif(*eng)) * bin_width);
+            cell_type->insertClone(*new_node);
+        }
+        bins[i] = 0;
+    }
+    addCells(1 - cell_count);
 }
 
 SexReprClone::SexReprClone(CellType& type) : Clone(type){
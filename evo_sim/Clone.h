@@ -13,6 +13,8 @@
 #include <vector>
 #include <queue>
 #include <string>
+#include "Diffusion1DBatch.h"
+#include "AlterationHistory.h"
 
 using namespace std;
 
@@ -59,7 +61,7 @@ public:
     
     virtual bool readLine(vector<string>& parsed_line) = 0;
     
-    void addCells(int num_cells);
+    void addCells(long long num_cells);
     
     double getMutProb(){
         return mut_prob;
@@ -99,6 +101,15 @@ public:
         cell_type = &type;
     }
     
+    /* forgets this clone's type and list neighbours without updating them. a detached clone can be deleted without touching any CellType.
+     only call when the whole clone list of the type is being discarded at once.
+     */
+    void detach(){
+        cell_type = NULL;
+        next_node = NULL;
+        prev_node = NULL;
+    }
+    
     Clone* getNextClone();
     
     /* removes one cell from this clone's population
@@ -144,19 +155,78 @@ public:
 
 class Diffusion1DClone: public UpdateClone{
 private:
-    double threshold;
-    double curr_pos;
-    double diffusion;
-    double drift;
+    // position, threshold, drift and diffusion live in the population's Diffusion1DBatch so whole populations can be stepped at once
+    Diffusion1DBatch *batch;
+    int slot;
+    void setSlot(int new_slot){
+        slot = new_slot;
+    }
     bool checkRep(){
-        return (diffusion >= 0 && drift >= 0 && curr_pos <= threshold && Clone::checkRep());
+        return (getDiffusion() >= 0 && getDrift() >= 0 && getPosition() <= getThreshold() && Clone::checkRep());
     };
 public:
     Diffusion1DClone(CellType& type);
     Diffusion1DClone(CellType& type, double b, double mu, double dr, double diff, double thresh, double pos);
+    ~Diffusion1DClone();
     void reproduce();
+    // reproduces and returns the new clone (a mutant or a copy of this one, at the same position)
+    Diffusion1DClone* divide();
     void update(double t);
     bool readLine(vector<string>& parsed_line);
+    double getPosition(){
+        return batch->position(slot);
+    }
+    void setPosition(double new_pos){
+        batch->position(slot) = new_pos;
+    }
+    double getThreshold(){
+        return batch->thresholdAt(slot);
+    }
+    double getDrift(){
+        return batch->driftAt(slot);
+    }
+    double getDiffusion(){
+        return batch->diffusionAt(slot);
+    }
+};
+
+class Diffusion1DDensityClone: public UpdateClone{
+    /* all cells of one CellType that share Diffusion1DClone parameters, stored as cell counts in bins of distance from 0 rather than one clone per cell.
+     memory does not grow with the number of cells. one step is a stochastic finite-volume version of the Diffusion1DClone update: cells hop between neighbouring bins
+     with probabilities that match the mean (and, where the bins resolve it, the variance) of a timestep, bin 0 reflects, cells leaving the last bin cross the threshold,
+     and deaths, births and mutants are drawn per bin. UpdateAllPop creates, steps and removes these clones; they never flag themselves for update().
+     */
+private:
+    double drift;
+    double diffusion;
+    double threshold;
+    double death_rate;
+    double bin_width;
+    std::vector<long long> bins;
+    std::vector<long long> moved;
+    // results of the last step, applied on the simulation thread by applyStep
+    long long new_count;
+    std::vector<double> mutant_positions;
+    int binOf(double pos);
+public:
+    Diffusion1DDensityClone(Diffusion1DClone& model, int num_bins);
+    // births are applied in bulk by applyStep
+    void reproduce(){}
+    void update(double t){}
+    bool readLine(vector<string>& parsed_line){
+        return false;
+    }
+    // @return true iff clone has the parameters of the cells in this density
+    bool matches(Diffusion1DClone& clone);
+    // moves the cell in clone into the density. the caller deletes clone afterwards.
+    void absorb(Diffusion1DClone& clone);
+    /* advances the density by one timestep of length t. touches only this clone's bins, so different densities can be stepped on different threads.
+     */
+    void step(double t);
+    // @return false if the density is empty after the step. it is then left holding one cell, so deleting it keeps the population's counts correct.
+    bool applyStep();
+    // replaces the density with individual Diffusion1DClones placed uniformly within their bins. leaves one cell for the caller to delete, as in applyStep.
+    void dissolve();
 };
 
 class EmpiricalClone: public StochClone{
@@ -173,7 +243,7 @@ public:
 
 class SimpleClone: public Clone{
 public:
-    SimpleClone(CellType& type, double b, double mut, int num_cells);
+    SimpleClone(CellType& type, double b, double mut, long long num_cells);
     SimpleClone(CellType& type);
     void reproduce();
     bool readLine(vector<string>& parsed_line);
@@ -226,8 +296,8 @@ public:
 class HerResetClone: public HeritableClone{
     // draws one new fitness alteration per generation, removes fitness alterations after exactly a given number of generations
 private:
-    // FIFO queue
-    queue<double> active_diff;
+    // FIFO queue, always holding num_gen_persist alterations
+    AlterationHistory active_diff;
     int num_gen_persist;
     
     // called in every reproduction to remove last alteration.
@@ -236,8 +306,8 @@ private:
         return active_diff.size() == num_gen_persist;
     };
 public:
-    HerResetClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, queue<double>& diffs, string dist);
-    HerResetClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, queue<double>& diffs, string dist);
+    HerResetClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, AlterationHistory& diffs, string dist);
+    HerResetClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, AlterationHistory& diffs, string dist);
     HerResetClone(CellType& type, bool mult);
     void reproduce();
     bool readLine(vector<string>& parsed_line);
@@ -246,7 +316,8 @@ public:
 class HerResetExpClone: public HerPoissonClone{
     // draws one new fitness alteration per generation, removes fitness alterations after an exponentially-distributed number of generations
 private:
-    vector<double> active_diff;
+    // shared with relatives until one of them changes it
+    SharedAlterationHistory active_diff;
     
     // Given as exponential rate constant.
     // The average lifetime is 1/time_constant.
@@ -255,6 +326,8 @@ private:
     // called in every reproduction to choose alteration to remove and remove alterations.
     // DOES NOT ADD ALTERATIONS! add_alteration() does this.
     void reset();
+    // @return number of alterations that survive before the next one expires, capped at the number of active alterations
+    int nextExpiry();
     
     double add_alteration();
 
@@ -262,8 +335,8 @@ private:
         return (accum_rate > 0 && time_constant > 0);
     };
 public:
-    HerResetExpClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, double time, double accum, vector<double>& diffs, string dist);
-    HerResetExpClone(CellType& type, double mu, double sig, double mut, bool mult, double time, double accum, vector<double>& diffs, string dist);
+    HerResetExpClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, double time, double accum, SharedAlterationHistory& diffs, string dist);
+    HerResetExpClone(CellType& type, double mu, double sig, double mut, bool mult, double time, double accum, SharedAlterationHistory& diffs, string dist);
     HerResetExpClone(CellType& type, bool mult);
     void reproduce();
     bool readLine(vector<string>& parsed_line);
@@ -298,16 +371,16 @@ public:
 
 class HerResetEmpiricClone: public HerEmpiricClone{
 private:
-    // FIFO queue
-    queue<double> active_diff;
+    // FIFO queue, always holding num_gen_persist alterations
+    AlterationHistory active_diff;
     int num_gen_persist;
     double reset();
     bool checkRep(){
         return active_diff.size() == num_gen_persist;
     };
 public:
-    HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, queue<double>& diffs);
-    HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, queue<double>& diffs);
+    HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, double offset, bool mult, int num_gen, AlterationHistory& diffs);
+    HerResetEmpiricClone(CellType& type, double mu, double sig, double mut, bool mult, int num_gen, AlterationHistory& diffs);
     HerResetEmpiricClone(CellType& type, bool mult);
     void reproduce();
     bool readLine(vector<string>& parsed_line);
@@ -317,6 +390,12 @@ class SexReprClone: public Clone{
 public:
     SexReprClone(CellType& type);
     SexReprClone(CellType& type, double b, double mu);
+    // reuses this clone for a new individual. should only be called while the clone is not in any CellType.
+    void setTraits(double b, double mu){
+        birth_rate = b;
+        mut_prob = mu;
+        cell_count = 1;
+    }
     void reproduce(){};
     SexReprClone& reproduce(SexReprClone& male);
     bool readLine(vector<string>& parsed_line);
@@ -0,0 +1,178 @@
+//
+//  Diffusion1DBatch.cpp
+//  evo_sim
+//
+//  Structure-of-arrays state and batched timestep kernel for Diffusion1DClones.
+//  This file is compiled with vectorization flags (see makefile); keep it free of the
+//  Clone/CellType linked list code.
+//
+
+#include "Diffusion1DBatch.h"
+#include <cmath>
+#include <vector>
+#include <string.h>
+
+using namespace std;
+
+int Diffusion1DBatch::add(Diffusion1DClone *clone, double b, double d){
+    clones.push_back(clone);
+    pos.push_back(0);
+    threshold.push_back(0);
+    drift.push_back(0);
+    diffusion.push_back(0);
+    birth.push_back(b);
+    death.push_back(d);
+    return int(clones.size()) - 1;
+}
+
+Diffusion1DClone* Diffusion1DBatch::remove(int slot){
+    int last = int(clones.size()) - 1;
+    Diffusion1DClone *moved = NULL;
+    if (slot != last){
+        moved = clones[last];
+        clones[slot] = clones[last];
+        pos[slot] = pos[last];
+        threshold[slot] = threshold[last];
+        drift[slot] = drift[last];
+        diffusion[slot] = diffusion[last];
+        birth[slot] = birth[last];
+        death[slot] = death[last];
+    }
+    clones.pop_back();
+    pos.pop_back();
+    threshold.pop_back();
+    drift.pop_back();
+    diffusion.pop_back();
+    birth.pop_back();
+    death.pop_back();
+    return moved;
+}
+
+void Diffusion1DBatch::prepareStep(){
+    size_t n = clones.size();
+    if (noise.size() < n){
+        unif_a.resize(n);
+        unif_b.resize(n);
+        unif_death.resize(n);
+        unif_birth.resize(n);
+        noise.resize(n);
+        flags.resize(n);
+    }
+}
+
+/* log, cos and sin for the Box-Muller transform, written as branch-free polynomials so the loops calling them vectorize:
+ the libm calls are scalar and stop the compiler from vectorizing any loop that contains them. both are accurate to a few ulp on the ranges used here.
+ */
+
+/* log of x > 0, from x = m * 2^e with m in [sqrt(1/2), sqrt(2)) and log(m) = 2 atanh((m - 1) / (m + 1)).
+ adding sqrt(2)'s distance from the next power of two to the bits carries into the exponent exactly when the mantissa is at least sqrt(2),
+ so e and m come out of integer arithmetic with no compare.
+ */
+static inline double polyLog(double x){
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(double));
+    uint64_t shifted = bits + 0x00095f619980c433ULL;
+    double e = double(int(shifted >> 52) - 1023);
+    bits = bits - (shifted & 0xfff0000000000000ULL) + 0x3ff0000000000000ULL;
+    double m;
+    memcpy(&m, &bits, sizeof(double));
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s;
+    // |s| <= 0.172, so the atanh series is exhausted by s^21
+    double series = 1.0/21;
+    series = series * s2 + 1.0/19;
+    series = series * s2 + 1.0/17;
+    series = series * s2 + 1.0/15;
+    series = series * s2 + 1.0/13;
+    series = series * s2 + 1.0/11;
+    series = series * s2 + 1.0/9;
+    series = series * s2 + 1.0/7;
+    series = series * s2 + 1.0/5;
+    series = series * s2 + 1.0/3;
+    series = series * s2 + 1.0;
+    return e * M_LN2 + 2.0 * s * series;
+}
+
+/* cos(2 pi v) (sin_offset 1) or sin(2 pi v) (sin_offset 0) for v in [0, 1), from an angle a in [-pi/4, pi/4] and q quarter turns:
+ each quarter turn rotates (cos, sin) to (-sin, cos). the quadrant is applied with arithmetic rather than selects so the loop stays branch-free.
+ */
+static inline double polyTurn(double v, int sin_offset){
+    int q = int(4.0 * v + 0.5);
+    double a = 2.0 * M_PI * (v - 0.25 * q);
+    double a2 = a * a;
+    double sin_a = -1.0/1307674368000;
+    sin_a = sin_a * a2 + 1.0/6227020800;
+    sin_a = sin_a * a2 - 1.0/39916800;
+    sin_a = sin_a * a2 + 1.0/362880;
+    sin_a = sin_a * a2 - 1.0/5040;
+    sin_a = sin_a * a2 + 1.0/120;
+    sin_a = sin_a * a2 - 1.0/6;
+    sin_a = a + a * a2 * sin_a;
+    double cos_a = 1.0/20922789888000;
+    cos_a = cos_a * a2 - 1.0/87178291200;
+    cos_a = cos_a * a2 + 1.0/479001600;
+    cos_a = cos_a * a2 - 1.0/3628800;
+    cos_a = cos_a * a2 + 1.0/40320;
+    cos_a = cos_a * a2 - 1.0/720;
+    cos_a = cos_a * a2 + 1.0/24;
+    cos_a = cos_a * a2 - 0.5;
+    cos_a = 1.0 + a2 * cos_a;
+    // odd quarter turns swap sin and cos; the sign flips for quadrants 1 and 2 of cos, 2 and 3 of sin
+    double swap = double((q + sin_offset + 1) & 1);
+    double sign = 1.0 - 2.0 * double(((q + sin_offset) >> 1) & 1);
+    return sign * (cos_a + swap * (sin_a - cos_a));
+}
+
+void Diffusion1DBatch::step(double t, int begin, int end, std::mt19937& rng){
+    int n = end - begin;
+    if (n <= 0){
+        return;
+    }
+    // the first half of the range takes the cosine Box-Muller variate of each pair, the second half the sine variate
+    int num_pairs = (n + 1) / 2;
+    const double to_unit = 1.0 / 4294967296.0;
+
+    // the engine itself is sequential; every loop after these two is branch-free and vectorized
+    for (int i=begin; i<begin+num_pairs; i++){
+        unif_a[i] = (double(rng()) + 0.5) * to_unit;
+        unif_b[i] = (double(rng()) + 0.5) * to_unit;
+    }
+    for (int i=begin; i<end; i++){
+        unif_death[i] = (double(rng()) + 0.5) * to_unit;
+        unif_birth[i] = (double(rng()) + 0.5) * to_unit;
+    }
+
+    double *ua = unif_a.data();
+    double *ub = unif_b.data();
+    double *z = noise.data();
+    int num_sin = n - num_pairs;
+    for (int k=0; k<num_pairs; k++){
+        double r = sqrt(-2.0 * polyLog(ua[begin + k]));
+        z[begin + k] = r * polyTurn(ub[begin + k], 1);
+    }
+    for (int k=0; k<num_sin; k++){
+        double r = sqrt(-2.0 * polyLog(ua[begin + k]));
+        z[begin + num_pairs + k] = r * polyTurn(ub[begin + k], 0);
+    }
+
+    // same model as Diffusion1DClone::update: the step is N(t*drift, t*diffusion), pushing away from 0
+    double *p = pos.data();
+    const double *thr = threshold.data();
+    const double *dr = drift.data();
+    const double *diff = diffusion.data();
+    const double *b = birth.data();
+    const double *d = death.data();
+    const double *ud = unif_death.data();
+    const double *ubirth = unif_birth.data();
+    double *f = flags.data();
+    for (int i=begin; i<end; i++){
+        double sign = (p[i] < 0) ? -1.0 : 1.0;
+        p[i] += sign * t * (dr[i] + diff[i] * z[i]);
+    }
+    // kept apart from the position update so each loop needs few enough alias checks to be vectorized. later selects take precedence: a cell that dies does not reproduce
+    for (int i=begin; i<end; i++){
+        double flag = (ubirth[i] < t * b[i]) ? REPRODUCED : 0.0;
+        flag = (ud[i] < t * d[i]) ? DIED : flag;
+        f[i] = (fabs(p[i]) > thr[i]) ? DIED : flag;
+    }
+}
@@ -0,0 +1,88 @@
+//
+//  Diffusion1DBatch.hpp
+//  evo_sim
+//
+//  Structure-of-arrays state and batched timestep kernel for Diffusion1DClones.
+//
+
+#ifndef Diffusion1DBatch_h
+#define Diffusion1DBatch_h
+
+#include <stdio.h>
+#include <vector>
+#include <random>
+#include <stdint.h>
+
+using namespace std;
+
+class Diffusion1DClone;
+
+class Diffusion1DBatch{
+    /* holds the state of every Diffusion1DClone in a population in flat arrays, one slot per clone.
+     slots are kept dense: removing a clone moves the last slot into the hole.
+     the timestep kernel (step) lives in its own translation unit so it can be compiled with vectorization enabled.
+     */
+private:
+    vector<Diffusion1DClone *> clones;
+    vector<double> pos;
+    vector<double> threshold;
+    vector<double> drift;
+    vector<double> diffusion;
+    vector<double> birth;
+    vector<double> death;
+
+    // per-step scratch, indexed by slot so that disjoint slot ranges can be stepped independently
+    vector<double> unif_a;
+    vector<double> unif_b;
+    vector<double> unif_death;
+    vector<double> unif_birth;
+    vector<double> noise;
+    // DIED, REPRODUCED or 0. held as doubles because SSE2 cannot turn a vector of double comparisons into narrower integers
+    vector<double> flags;
+public:
+    static const unsigned char DIED = 1;
+    static const unsigned char REPRODUCED = 2;
+
+    // @return slot of the newly added clone
+    int add(Diffusion1DClone *clone, double b, double d);
+    // @return clone whose state moved into slot, which must be told its new slot; NULL if none moved
+    Diffusion1DClone* remove(int slot);
+
+    int size(){
+        return int(clones.size());
+    }
+    Diffusion1DClone* getClone(int slot){
+        return clones[slot];
+    }
+    double& position(int slot){
+        return pos[slot];
+    }
+    double& thresholdAt(int slot){
+        return threshold[slot];
+    }
+    double& driftAt(int slot){
+        return drift[slot];
+    }
+    double& diffusionAt(int slot){
+        return diffusion[slot];
+    }
+    double& birthAt(int slot){
+        return birth[slot];
+    }
+    double& deathAt(int slot){
+        return death[slot];
+    }
+    unsigned char getFlags(int slot){
+        return (unsigned char)(flags[slot]);
+    }
+
+    // sizes the scratch arrays for the current number of clones. call once before stepping any range.
+    void prepareStep();
+
+    /* advances slots [begin, end) by one timestep of length t: moves every position and flags deaths (threshold crossing or death draw) and births.
+     all random numbers come from rng, so disjoint ranges can be stepped on different threads with different engines.
+     */
+    void step(double t, int begin, int end, std::mt19937& rng);
+};
+
+#endif /* Diffusion1DBatch_h */
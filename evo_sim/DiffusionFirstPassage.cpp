@@ -0,0 +1,262 @@
+//
+//  DiffusionFirstPassage.cpp
+//  evo_sim
+//
+//  Exact first-passage and conditional position sampling for the Diffusion1DClone position process.
+//
+
+#include "DiffusionFirstPassage.h"
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+// series terms are dropped once they have decayed by e^-SERIES_TAIL
+static const double SERIES_TAIL = 40;
+// beyond this many terms the short-time law is used for hitting times, and the non-interacting approximation for positions
+static const int MAX_TIME_TERMS = 64;
+static const int MAX_POSITION_TERMS = 512;
+// largest theta*a handled by the series directly, and theta*c at the split point used above it (e^{-2 theta c} is below double precision)
+static const double MAX_PECLET = 20;
+static const double SPLIT_PECLET = 19;
+
+// log(erfc(z)) without underflow for large z
+static double logErfc(double z){
+    if (z < 25){
+        return log(erfc(z));
+    }
+    return -z*z - log(z*sqrt(M_PI)) + log1p(-0.5/(z*z));
+}
+
+DiffusionFirstPassage::DiffusionFirstPassage(double drift, double diffusion, double threshold){
+    mu = drift;
+    sigma = diffusion;
+    a = threshold;
+    theta = (sigma > 0) ? mu/(sigma*sigma) : 0;
+    inner = NULL;
+    split = a;
+    if (sigma > 0 && theta*a > MAX_PECLET){
+        split = SPLIT_PECLET/theta;
+        inner = new DiffusionFirstPassage(mu, sigma, split);
+    }
+}
+
+DiffusionFirstPassage::~DiffusionFirstPassage(){
+    delete inner;
+}
+
+void DiffusionFirstPassage::addTerms(int n){
+    while (int(k.size()) < n){
+        int index = int(k.size()) + 1;
+        // k_n is the root of k a + atan(k/theta) = n pi in ((n-1/2) pi/a, n pi/a). the function is increasing and concave, so Newton from the left converges monotonically.
+        double root = (index - 0.5)*M_PI/a;
+        if (theta > 0){
+            for (int i=0; i<100; i++){
+                double f = root*a + atan(root/theta) - index*M_PI;
+                double step = f/(a + theta/(theta*theta + root*root));
+                root -= step;
+                if (fabs(step) < 1e-15*root){
+                    break;
+                }
+            }
+        }
+        double beta = theta/root;
+        double s2 = sin(2*root*a);
+        double c2 = cos(2*root*a);
+        k.push_back(root);
+        norm.push_back(a/2 + s2/(4*root) + beta*(1 - c2)/(2*root) + beta*beta*(a/2 - s2/(4*root)));
+    }
+}
+
+int DiffusionFirstPassage::termsFor(double t, int max_terms){
+    if (t <= 0){
+        return -1;
+    }
+    double k_max = sqrt(2*SERIES_TAIL/(sigma*sigma*t));
+    double n = k_max*a/M_PI + 2;
+    if (n > max_terms){
+        return -1;
+    }
+    return int(n);
+}
+
+double DiffusionFirstPassage::seriesSurvival(double y, double t, int n, double& density){
+    addTerms(n);
+    // e^{theta (a - y)} and e^{-mu^2 t/(2 sigma^2)} are common to every term
+    double base_rate = mu*mu/(2*sigma*sigma);
+    double prefactor = exp(theta*(a - y) - base_rate*t);
+    double sum = 0;
+    double density_sum = 0;
+    for (int i=0; i<n; i++){
+        double rate = sigma*sigma*k[i]*k[i]/2;
+        double g = cos(k[i]*y) + (theta/k[i])*sin(k[i]*y);
+        double term = g*sin(k[i]*a)/(k[i]*norm[i])*exp(-rate*t);
+        sum += term;
+        density_sum += term*(rate + base_rate);
+    }
+    density = prefactor*density_sum;
+    return fmin(1.0, fmax(0.0, prefactor*sum));
+}
+
+double DiffusionFirstPassage::shortSurvival(double y, double t, double& density){
+    double dist = a - y;
+    double spread = sigma*sqrt(t);
+    double direct = 0.5*erfc((dist - mu*t)/(spread*M_SQRT2));
+    double image = 0.5*exp(2*theta*dist + logErfc((dist + mu*t)/(spread*M_SQRT2)));
+    density = dist/(spread*t*sqrt(2*M_PI))*exp(-(dist - mu*t)*(dist - mu*t)/(2*spread*spread));
+    return fmin(1.0, fmax(0.0, 1 - direct - image));
+}
+
+double DiffusionFirstPassage::survival(double y, double t, double& density){
+    int n = termsFor(t, MAX_TIME_TERMS);
+    if (n < 0){
+        return shortSurvival(y, t, density);
+    }
+    return seriesSurvival(y, t, n, density);
+}
+
+double DiffusionFirstPassage::sampleInverseGaussian(double dist, double drift, double vol, std::mt19937& rng){
+    normal_distribution<double> rnorm;
+    double z = rnorm(rng);
+    if (drift <= 0){
+        // driftless passage times are Levy distributed
+        return dist*dist/(vol*vol*z*z);
+    }
+    // Michael, Schucany and Haas (1976)
+    uniform_real_distribution<double> runif;
+    double mean = dist/drift;
+    double shape = dist*dist/(vol*vol);
+    double z2 = z*z;
+    double x = mean + mean*mean*z2/(2*shape) - mean/(2*shape)*sqrt(4*mean*shape*z2 + mean*mean*z2*z2);
+    if (runif(rng) <= mean/(mean + x)){
+        return x;
+    }
+    return mean*mean/x;
+}
+
+double DiffusionFirstPassage::sampleHittingTime(double y, std::mt19937& rng){
+    if (y >= a){
+        return 0;
+    }
+    if (sigma <= 0){
+        return (mu > 0) ? (a - y)/mu : numeric_limits<double>::infinity();
+    }
+    if (inner){
+        if (y >= split){
+            return sampleInverseGaussian(a - y, mu, sigma, rng);
+        }
+        return inner->sampleHittingTime(y, rng) + sampleInverseGaussian(a - split, mu, sigma, rng);
+    }
+
+    // invert the survival function with Newton steps, falling back to bisection whenever a step leaves the bracket
+    uniform_real_distribution<double> runif;
+    double target = 1 - runif(rng);
+    double density;
+    addTerms(1);
+    double lo = 0;
+    double hi = 1/(sigma*sigma*k[0]*k[0]/2 + mu*mu/(2*sigma*sigma));
+    while (survival(y, hi, density) > target){
+        lo = hi;
+        hi *= 2;
+    }
+    double t = hi;
+    for (int i=0; i<200; i++){
+        double surv = survival(y, t, density);
+        if (surv > target){
+            lo = t;
+        }
+        else{
+            hi = t;
+        }
+        if (fabs(surv - target) <= 1e-12*target || hi - lo <= 1e-12*hi){
+            break;
+        }
+        double next = (density > 0) ? t + (surv - target)/density : -1;
+        if (!(next > lo && next < hi)){
+            next = 0.5*(lo + hi);
+        }
+        t = next;
+    }
+    return t;
+}
+
+double DiffusionFirstPassage::sampleShortPosition(double y, double s, std::mt19937& rng){
+    normal_distribution<double> rnorm;
+    uniform_real_distribution<double> runif;
+    double var = sigma*sigma*s;
+    while (true){
+        // endpoint of the free path, then the reflected endpoint via the minimum of the Brownian bridge between them (Skorokhod)
+        double x = y + mu*s + sqrt(var)*rnorm(rng);
+        double lowest = 0.5*(y + x - sqrt((x - y)*(x - y) - 2*var*log(1 - runif(rng))));
+        double end = (lowest < 0) ? x - lowest : x;
+        if (end >= a){
+            continue;
+        }
+        // keep the path only if its bridge stays below the threshold
+        if (runif(rng) < 1 - exp(-2*(a - y)*(a - end)/var)){
+            return end;
+        }
+    }
+}
+
+double DiffusionFirstPassage::samplePosition(double y, double s, std::mt19937& rng){
+    if (s <= 0 || y >= a){
+        return fmin(y, a);
+    }
+    if (sigma <= 0){
+        return fmin(y + mu*s, a);
+    }
+    int n = inner ? -1 : termsFor(s, MAX_POSITION_TERMS);
+    if (n < 0){
+        return sampleShortPosition(y, s, rng);
+    }
+    addTerms(n);
+    // the conditional CDF is proportional to e^{theta x} sum_n w_n sin(k_n x), since phi_n(x) e^{2 theta x} integrates to e^{theta x} sin(k_n x)/k_n
+    weights.resize(n);
+    for (int i=0; i<n; i++){
+        double g = cos(k[i]*y) + (theta/k[i])*sin(k[i]*y);
+        weights[i] = g*exp(-sigma*sigma*k[i]*k[i]*s/2)/(norm[i]*k[i]);
+    }
+    double total = 0;
+    for (int i=0; i<n; i++){
+        total += weights[i]*sin(k[i]*a);
+    }
+    total *= exp(theta*a);
+    if (!(total > 0)){
+        return sampleShortPosition(y, s, rng);
+    }
+
+    uniform_real_distribution<double> runif;
+    double target = runif(rng)*total;
+    double lo = 0;
+    double hi = a;
+    double x = (y > 0) ? y : 0.5*a;
+    for (int iter=0; iter<200; iter++){
+        double cdf = 0;
+        double density = 0;
+        for (int i=0; i<n; i++){
+            double sk = sin(k[i]*x);
+            cdf += weights[i]*sk;
+            density += weights[i]*(k[i]*cos(k[i]*x) + theta*sk);
+        }
+        double growth = exp(theta*x);
+        cdf *= growth;
+        density *= growth;
+        if (cdf < target){
+            lo = x;
+        }
+        else{
+            hi = x;
+        }
+        if (hi - lo <= 1e-12*a || fabs(cdf - target) <= 1e-12*total){
+            break;
+        }
+        double next = (density > 0) ? x + (target - cdf)/density : -1;
+        if (!(next > lo && next < hi)){
+            next = 0.5*(lo + hi);
+        }
+        x = next;
+    }
+    return x;
+}
@@ -0,0 +1,63 @@
+//
+//  DiffusionFirstPassage.hpp
+//  evo_sim
+//
+//  Exact first-passage and conditional position sampling for the Diffusion1DClone position process.
+//
+
+#ifndef DiffusionFirstPassage_h
+#define DiffusionFirstPassage_h
+
+#include <stdio.h>
+#include <vector>
+#include <random>
+
+using namespace std;
+
+class DiffusionFirstPassage{
+    /* samples from the continuous-time limit of the Diffusion1DClone position. only the distance from 0 matters to that model, so the process sampled here is
+     Y = |position|: a Brownian motion with drift mu >= 0 and volatility sigma, reflected at 0 and absorbed at the threshold a.
+     sampling uses the spectral expansion of the killed process. with theta = mu/sigma^2 its eigenfunctions are phi_n(x) = e^{-theta x}(cos k_n x + (theta/k_n) sin k_n x),
+     where tan(k_n a) = -k_n/theta, with eigenvalues lambda_n = sigma^2 k_n^2/2 + mu^2/(2 sigma^2). short times, where the series converges slowly, use the one-sided
+     (inverse Gaussian) first passage law instead, which agrees with the two-sided law to well below double precision there.
+     roots are computed lazily and kept, so one object should be shared by every clone with the same parameters.
+     */
+private:
+    double mu;
+    double sigma;
+    double a;
+    double theta;
+    // roots k_n and squared norms of cos k_n x + (theta/k_n) sin k_n x over [0, a]
+    vector<double> k;
+    vector<double> norm;
+    // per-term weights of the conditional position distribution, reused between samples
+    vector<double> weights;
+    /* the series loses precision as theta*a grows (terms of size e^{theta*a} cancel). for strongly drifted processes the interval is split at c, where theta*c is moderate:
+     below c the series for [0, c] is used, and from c a path essentially never returns to 0, so the one-sided law is exact from there on.
+     */
+    DiffusionFirstPassage *inner;
+    double split;
+
+    void addTerms(int n);
+    // @return number of series terms needed at time t, or -1 if more than max_terms
+    int termsFor(double t, int max_terms);
+    double seriesSurvival(double y, double t, int n, double& density);
+    double shortSurvival(double y, double t, double& density);
+    // @return P(no absorption before t | start at y). density is set to the first passage density at t.
+    double survival(double y, double t, double& density);
+    double sampleShortPosition(double y, double s, std::mt19937& rng);
+    static double sampleInverseGaussian(double dist, double drift, double vol, std::mt19937& rng);
+public:
+    DiffusionFirstPassage(double drift, double diffusion, double threshold);
+    ~DiffusionFirstPassage();
+
+    // @return time for Y to reach the threshold starting from y (infinity if it never does)
+    double sampleHittingTime(double y, std::mt19937& rng);
+
+    /* @return Y after time s starting from y, conditional on Y not having reached the threshold by s.
+     exact except for strongly drifted processes and very short s, where reflection and absorption are treated as not interacting.
+     */
+    double samplePosition(double y, double s, std::mt19937& rng);
+};
+
+#endif /* DiffusionFirstPassage_h */
@@ -0,0 +1,67 @@
+//
+//  DistributionStore.cpp
+//  evo_sim
+//
+//  Process-wide store of empirical fitness distributions read from files.
+//
+
+#include "DistributionStore.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+
+pthread_mutex_t DistributionStore::lock = PTHREAD_MUTEX_INITIALIZER;
+map<string, const vector<double> *> DistributionStore::loaded;
+
+vector<double> *DistributionStore::readFile(const string& filename){
+    ifstream infile(filename);
+    if (!infile.is_open()){
+        return NULL;
+    }
+    stringstream contents;
+    contents << infile.rdbuf();
+    string text = contents.str();
+    
+    vector<double> *values = new vector<double>();
+    const char *curr = text.c_str();
+    while (true){
+        while (isspace((unsigned char)*curr)){
+            curr++;
+        }
+        if (*curr == '\0'){
+            break;
+        }
+        char *end;
+        double value = strtod(curr, &end);
+        if (end == curr){
+            delete values;
+            return NULL;
+        }
+        values->push_back(value);
+        curr = end;
+    }
+    if (values->empty()){
+        delete values;
+        return NULL;
+    }
+    values->shrink_to_fit();
+    return values;
+}
+
+const vector<double> *DistributionStore::load(const string& filename){
+    pthread_mutex_lock(&lock);
+    map<string, const vector<double> *>::iterator found = loaded.find(filename);
+    if (found != loaded.end()){
+        const vector<double> *values = found->second;
+        pthread_mutex_unlock(&lock);
+        return values;
+    }
+    // files are small next to a simulation, so reading under the lock keeps every thread waiting for the one copy
+    const vector<double> *values = readFile(filename);
+    if (values){
+        loaded[filename] = values;
+    }
+    pthread_mutex_unlock(&lock);
+    return values;
+}
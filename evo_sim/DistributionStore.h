@@ -0,0 +1,34 @@
+//
+//  DistributionStore.hpp
+//  evo_sim
+//
+//  Process-wide store of empirical fitness distributions read from files.
+//
+
+#ifndef DistributionStore_h
+#define DistributionStore_h
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <pthread.h>
+
+using namespace std;
+
+class DistributionStore{
+    /* each distribution file is read once per process, however many simulation threads and cell types use it. the values are never changed or freed after loading,
+     so cell types share them by pointer and may read them from any thread without locking.
+     THREAD SAFE
+     */
+private:
+    static pthread_mutex_t lock;
+    static map<string, const vector<double> *> loaded;
+    // @return values in filename (separated by whitespace), or NULL if it cannot be read or holds no values
+    static vector<double> *readFile(const string& filename);
+public:
+    // @return shared values of the distribution in filename, or NULL if it cannot be read
+    static const vector<double> *load(const string& filename);
+};
+
+#endif /* DistributionStore_h */
@@ -0,0 +1,134 @@
+//
+//  EnsembleStats.cpp
+//  evo_sim
+//
+//  Statistics accumulated across simulations, one value per simulation at a time.
+//
+
+#include "EnsembleStats.h"
+#include <cmath>
+
+Moments::Moments(){
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    min = 0;
+    max = 0;
+}
+
+void Moments::add(double x){
+    if (count == 0 || x < min){
+        min = x;
+    }
+    if (count == 0 || x > max){
+        max = x;
+    }
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+void Moments::merge(const Moments& other){
+    if (other.count == 0){
+        return;
+    }
+    if (count == 0){
+        *this = other;
+        return;
+    }
+    long long new_count = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / new_count;
+    m2 += other.m2 + delta * delta * count * other.count / new_count;
+    count = new_count;
+    min = other.min < min ? other.min : min;
+    max = other.max > max ? other.max : max;
+}
+
+double Moments::getSD(){
+    return count > 1 ? sqrt(m2 / (count - 1)) : 0;
+}
+
+ValueSummary::ValueSummary(){
+    setAccuracy(0.01);
+}
+
+void ValueSummary::setAccuracy(double accuracy){
+    moments = Moments();
+    sketch.setRelative(accuracy);
+}
+
+void ValueSummary::add(double x){
+    moments.add(x);
+    sketch.add(x, 1);
+}
+
+void ValueSummary::merge(const ValueSummary& other){
+    moments.merge(other.moments);
+    sketch.merge(other.sketch);
+}
+
+void ValueSummary::write(ostream& out){
+    out << moments.getCount() << ", " << moments.getMean() << ", " << moments.getSD() << ", " << moments.getMin();
+    double quantiles[5] = {0.05, 0.25, 0.5, 0.75, 0.95};
+    for (int i=0; i<5; i++){
+        // the sketch's bins reach past the values actually seen
+        double quantile = sketch.quantile(quantiles[i]);
+        quantile = quantile < moments.getMin() ? moments.getMin() : quantile;
+        quantile = quantile > moments.getMax() ? moments.getMax() : quantile;
+        out << ", " << quantile;
+    }
+    out << ", " << moments.getMax();
+}
+
+EnsembleSummary::EnsembleSummary(){
+    interval = 1;
+    num_sims = 0;
+    num_extinct = 0;
+}
+
+void EnsembleSummary::setGrid(double new_interval, int num_points, double accuracy){
+    interval = new_interval;
+    points.assign(num_points, ValueSummary());
+    for (int i=0; i<num_points; i++){
+        points[i].setAccuracy(accuracy);
+    }
+    end_time.setAccuracy(accuracy);
+    num_sims = 0;
+    num_extinct = 0;
+}
+
+void EnsembleSummary::addEnd(double time, bool extinct){
+    end_time.add(time);
+    num_sims++;
+    if (extinct){
+        num_extinct++;
+    }
+}
+
+void EnsembleSummary::merge(const EnsembleSummary& other){
+    for (int i=0; i<int(points.size()) && i<int(other.points.size()); i++){
+        points[i].merge(other.points[i]);
+    }
+    end_time.merge(other.end_time);
+    num_sims += other.num_sims;
+    num_extinct += other.num_extinct;
+}
+
+void EnsembleSummary::write(ostream& out){
+    out << "simulations, extinct, extinction probability" << endl;
+    out << num_sims << ", " << num_extinct << ", " << (num_sims > 0 ? double(num_extinct) / num_sims : 0) << endl;
+    out << "end time: simulations, mean, sd, min, 5%, 25%, 50%, 75%, 95%, max" << endl;
+    end_time.write(out);
+    out << endl;
+    out << "time, simulations, mean, sd, min, 5%, 25%, 50%, 75%, 95%, max" << endl;
+    for (int i=0; i<int(points.size()); i++){
+        if (points[i].getCount() == 0){
+            continue;
+        }
+        out << pointTime(i) << ", ";
+        points[i].write(out);
+        out << endl;
+    }
+}
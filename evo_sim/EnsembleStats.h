@@ -0,0 +1,98 @@
+//
+//  EnsembleStats.hpp
+//  evo_sim
+//
+//  Statistics accumulated across simulations, one value per simulation at a time.
+//
+
+#ifndef EnsembleStats_h
+#define EnsembleStats_h
+
+#include <stdio.h>
+#include <vector>
+#include <ostream>
+#include "FitnessHistogram.h"
+
+using namespace std;
+
+class Moments{
+    /* running count, mean, variance, minimum and maximum of a stream of values, by Welford's method.
+     two sets of moments merge exactly, so each thread can keep its own and combine them at the end.
+     */
+private:
+    long long count;
+    double mean;
+    // sum of squared differences from the mean
+    double m2;
+    double min;
+    double max;
+public:
+    Moments();
+    void add(double x);
+    void merge(const Moments& other);
+    long long getCount(){
+        return count;
+    }
+    double getMean(){
+        return mean;
+    }
+    double getSD();
+    double getMin(){
+        return min;
+    }
+    double getMax(){
+        return max;
+    }
+};
+
+class ValueSummary{
+    /* moments and quantiles of one value. the quantiles come from a logarithmic histogram (a FitnessHistogram in relative mode),
+     which is within a relative accuracy of the true quantile and takes space logarithmic in the range of the values, however many are added.
+     */
+private:
+    Moments moments;
+    FitnessHistogram sketch;
+public:
+    ValueSummary();
+    // @param accuracy relative error of the quantiles
+    void setAccuracy(double accuracy);
+    void add(double x);
+    void merge(const ValueSummary& other);
+    long long getCount(){
+        return moments.getCount();
+    }
+    // writes count, mean, standard deviation, minimum, 5th, 25th, 50th, 75th and 95th percentiles and maximum
+    void write(ostream& out);
+};
+
+class EnsembleSummary{
+    /* the cell count of each simulation at the points of a time grid (0, interval, 2 interval, ...), the time each simulation ended and how many went extinct.
+     a simulation contributes to a grid point only if it was still running at that time, or had gone extinct before it.
+     */
+private:
+    double interval;
+    vector<ValueSummary> points;
+    ValueSummary end_time;
+    long long num_sims;
+    long long num_extinct;
+public:
+    EnsembleSummary();
+    void setGrid(double new_interval, int num_points, double accuracy);
+    double getInterval(){
+        return interval;
+    }
+    int getNumPoints(){
+        return int(points.size());
+    }
+    double pointTime(int i){
+        return i * interval;
+    }
+    void addPoint(int i, double count){
+        points[i].add(count);
+    }
+    void addEnd(double time, bool extinct);
+    void merge(const EnsembleSummary& other);
+    void write(ostream& out);
+};
+
+#endif /* EnsembleStats_h */
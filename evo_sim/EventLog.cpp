@@ -0,0 +1,344 @@
+//
+//  EventLog.cpp
+//  evo_sim
+//
+//  Binary log of every change a simulation makes to its population, replayed by ReplayPop.
+//
+
+#include "EventLog.h"
+#include <string.h>
+
+const char EventLog::MAGIC[4] = {'E', 'L', 'O', 'G'};
+
+static void putBytes(string& dest, unsigned long long value, int num_bytes){
+    for (int i=0; i<num_bytes; i++){
+        dest.push_back(char(value & 0xff));
+        value >>= 8;
+    }
+}
+
+static void putVarint(string& dest, unsigned long long value){
+    while (value >= 0x80){
+        dest.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    dest.push_back(char(value));
+}
+
+static long long toBits(double value){
+    long long bits;
+    memcpy(&bits, &value, sizeof(double));
+    return bits;
+}
+
+static double fromBits(long long bits){
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+}
+
+static void putDouble(string& dest, double value){
+    putBytes(dest, (unsigned long long)toBits(value), 8);
+}
+
+static unsigned long long zigzag(long long value){
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value){
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+EventLog::EventLog(){
+    out = NULL;
+    time_bits = 0;
+    mother_birth = 0;
+    daughter_birth = 0;
+}
+
+void EventLog::begin(ostream& new_out, int max_types){
+    out = &new_out;
+    block.clear();
+    keys.clear();
+    time_bits = toBits(0);
+    mother_birth = 0;
+    daughter_birth = 0;
+    block.append(MAGIC, 4);
+    putBytes(block, VERSION, 1);
+    putVarint(block, max_types);
+}
+
+void EventLog::send(){
+    out->write(block.data(), block.size());
+    block.clear();
+}
+
+int EventLog::getKey(int type_index, double b){
+    pair<int, double> type_rate(type_index, b);
+    map<pair<int, double>, int>::iterator found = keys.find(type_rate);
+    if (found != keys.end()){
+        return found->second;
+    }
+    int key = int(keys.size());
+    keys[type_rate] = key;
+    putBytes(block, KEY, 1);
+    putVarint(block, type_index);
+    putDouble(block, b);
+    return key;
+}
+
+void EventLog::addType(int index, int parent, bool is_root){
+    putBytes(block, TYPE, 1);
+    putVarint(block, index);
+    putVarint(block, parent + 1);
+    putVarint(block, is_root);
+}
+
+void EventLog::cellsChanged(int type_index, double b, long long num){
+    if (num == 0){
+        return;
+    }
+    int key = getKey(type_index, b);
+    if (num == -1){
+        putBytes(block, DEATH, 1);
+        putVarint(block, key);
+    }
+    else if (num < 0){
+        putBytes(block, REMOVE, 1);
+        putVarint(block, key);
+        putVarint(block, -num);
+    }
+    else if (num == 1){
+        putBytes(block, BIRTH, 1);
+        putVarint(block, key);
+    }
+    else{
+        putBytes(block, ADD, 1);
+        putVarint(block, key);
+        putVarint(block, num);
+    }
+}
+
+void EventLog::typeDetached(int type_index){
+    putBytes(block, DETACH, 1);
+    putVarint(block, type_index);
+}
+
+void EventLog::beginSteps(double time){
+    putBytes(block, BEGIN, 1);
+    putDouble(block, time);
+    time_bits = toBits(time);
+}
+
+void EventLog::endStep(double time, int new_type, int parent, double new_mother_birth, double new_daughter_birth){
+    putBytes(block, STEP, 1);
+    long long new_time_bits = toBits(time);
+    putVarint(block, zigzag(new_time_bits - time_bits));
+    time_bits = new_time_bits;
+    bool fitness_changed = new_mother_birth != mother_birth || new_daughter_birth != daughter_birth;
+    putBytes(block, (new_type >= 0 ? MUTATION : 0) | (fitness_changed ? FITNESS : 0), 1);
+    if (new_type >= 0){
+        putVarint(block, new_type);
+        putVarint(block, parent + 1);
+    }
+    if (fitness_changed){
+        putDouble(block, new_mother_birth);
+        putDouble(block, new_daughter_birth);
+        mother_birth = new_mother_birth;
+        daughter_birth = new_daughter_birth;
+    }
+    if (block.size() >= BLOCK_SIZE){
+        send();
+    }
+}
+
+void EventLog::finish(bool extinct){
+    if (!out){
+        return;
+    }
+    putBytes(block, END, 1);
+    putBytes(block, extinct, 1);
+    send();
+    out = NULL;
+    keys.clear();
+}
+
+EventLogReader::EventLogReader(){
+    file = NULL;
+    max_types = 0;
+    time_bits = 0;
+    mother_birth = 0;
+    daughter_birth = 0;
+}
+
+EventLogReader::~EventLogReader(){
+    close();
+}
+
+void EventLogReader::close(){
+    if (file){
+        fclose(file);
+        file = NULL;
+    }
+}
+
+bool EventLogReader::readVarint(unsigned long long& value){
+    value = 0;
+    for (int shift=0; shift<64; shift+=7){
+        int byte = getc(file);
+        if (byte == EOF){
+            return false;
+        }
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventLogReader::readDouble(double& value){
+    unsigned char bytes[8];
+    if (fread(bytes, 1, 8, file) != 8){
+        return false;
+    }
+    unsigned long long bits = 0;
+    for (int i=7; i>=0; i--){
+        bits = (bits << 8) | bytes[i];
+    }
+    value = fromBits((long long)bits);
+    return true;
+}
+
+bool EventLogReader::open(const string& filename){
+    close();
+    file = fopen(filename.c_str(), "rb");
+    if (!file){
+        return false;
+    }
+    char magic[4];
+    unsigned long long value;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, EventLog::MAGIC, 4) != 0 || getc(file) != EventLog::VERSION || !readVarint(value)){
+        close();
+        return false;
+    }
+    max_types = int(value);
+    key_types.clear();
+    key_rates.clear();
+    time_bits = toBits(0);
+    mother_birth = 0;
+    daughter_birth = 0;
+    return true;
+}
+
+int EventLogReader::peekKind(){
+    if (!file){
+        return 0;
+    }
+    int kind = getc(file);
+    if (kind == EOF){
+        return 0;
+    }
+    ungetc(kind, file);
+    return kind;
+}
+
+bool EventLogReader::next(EventRecord& record){
+    if (!file){
+        return false;
+    }
+    int kind = getc(file);
+    if (kind == EOF){
+        return false;
+    }
+    record.kind = kind;
+    unsigned long long a, b, c;
+    switch (kind){
+        case EventLog::TYPE:
+            if (!readVarint(a) || !readVarint(b) || !readVarint(c)){
+                return false;
+            }
+            record.type_index = int(a);
+            record.parent = int(b) - 1;
+            record.is_root = c != 0;
+            return true;
+        case EventLog::KEY:
+            if (!readVarint(a) || !readDouble(record.birth_rate)){
+                return false;
+            }
+            record.type_index = int(a);
+            record.key = int(key_types.size());
+            key_types.push_back(record.type_index);
+            key_rates.push_back(record.birth_rate);
+            return true;
+        case EventLog::BIRTH:
+        case EventLog::ADD:
+        case EventLog::DEATH:
+        case EventLog::REMOVE:
+            if (!readVarint(a) || a >= key_types.size()){
+                return false;
+            }
+            record.key = int(a);
+            record.type_index = key_types[a];
+            record.birth_rate = key_rates[a];
+            record.num_cells = kind == EventLog::DEATH ? -1 : 1;
+            if (kind == EventLog::ADD){
+                if (!readVarint(b)){
+                    return false;
+                }
+                record.num_cells = (long long)b;
+            }
+            else if (kind == EventLog::REMOVE){
+                if (!readVarint(b)){
+                    return false;
+                }
+                record.num_cells = -(long long)b;
+            }
+            return true;
+        case EventLog::DETACH:
+            if (!readVarint(a)){
+                return false;
+            }
+            record.type_index = int(a);
+            return true;
+        case EventLog::BEGIN:
+            if (!readDouble(record.time)){
+                return false;
+            }
+            time_bits = toBits(record.time);
+            return true;
+        case EventLog::STEP:{
+            int flags;
+            if (!readVarint(a) || (flags = getc(file)) == EOF){
+                return false;
+            }
+            time_bits += unzigzag(a);
+            record.time = fromBits(time_bits);
+            record.has_mutation = flags & EventLog::MUTATION;
+            if (record.has_mutation){
+                if (!readVarint(b) || !readVarint(c)){
+                    return false;
+                }
+                record.type_index = int(b);
+                record.parent = int(c) - 1;
+            }
+            if (flags & EventLog::FITNESS){
+                if (!readDouble(mother_birth) || !readDouble(daughter_birth)){
+                    return false;
+                }
+            }
+            record.mother_birth = mother_birth;
+            record.daughter_birth = daughter_birth;
+            return true;
+        }
+        case EventLog::END:{
+            int extinct = getc(file);
+            if (extinct == EOF){
+                return false;
+            }
+            record.extinct = extinct != 0;
+            return true;
+        }
+    }
+    return false;
+}
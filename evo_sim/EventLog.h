@@ -0,0 +1,120 @@
+//
+//  EventLog.hpp
+//  evo_sim
+//
+//  Binary log of every change a simulation makes to its population, replayed by ReplayPop.
+//
+
+#ifndef EventLog_h
+#define EventLog_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+
+using namespace std;
+
+/* an event log (.elog) holds one simulation. all numbers are varints unless noted; doubles are 8 bytes, little endian.
+ header: "ELOG", u8 version, max types (as given to pop_params).
+ then records, each a u8 kind followed by its fields:
+     TYPE: type index, parent index + 1 (0 for none), 1 if a root type
+     KEY: type index, birth rate (double). declares the next key, a (type, birth rate) pair that cell records refer to
+     BIRTH: key. one cell added
+     ADD: key, number of cells
+     DEATH: key. one cell removed
+     REMOVE: key, number of cells. several cells removed at once, as when a density clone steps
+     DETACH: type index. every cell of the type removed at once
+     BEGIN: time (double). the initial population is complete
+     STEP: zigzag(time bits - previous time bits), u8 flags, then if MUTATION: new type index, its parent index + 1,
+         then if FITNESS: mother and daughter birth rates (doubles). one call to CList::advance
+     END: u8 1 if the population was extinct
+ */
+class EventLog{
+    /* encodes the records of one simulation and writes them to a stream in blocks.
+     cell records cost 2-4 bytes, so a log is usually much smaller than the text output of the writers it replaces.
+     */
+public:
+    enum Kind {TYPE = 1, KEY, BIRTH, ADD, DEATH, DETACH, BEGIN, STEP, END, REMOVE};
+    // STEP flags
+    static const int MUTATION = 1;
+    static const int FITNESS = 2;
+    static const char MAGIC[4];
+    static const int VERSION = 1;
+    static const size_t BLOCK_SIZE = 1 << 16;
+private:
+    ostream *out;
+    string block;
+    map<pair<int, double>, int> keys;
+    long long time_bits;
+    double mother_birth;
+    double daughter_birth;
+    int getKey(int type_index, double b);
+    void send();
+public:
+    EventLog();
+    void begin(ostream& new_out, int max_types);
+    // @param parent index of the parent type, or -1 if none
+    void addType(int index, int parent, bool is_root);
+    // @param num cells added with birth rate b (> 0) or removed (< 0)
+    void cellsChanged(int type_index, double b, long long num);
+    void typeDetached(int type_index);
+    // ends the initial population
+    void beginSteps(double time);
+    // @param new_type index of the type mutated into, or -1 if the step had no mutation
+    void endStep(double time, int new_type, int parent, double new_mother_birth, double new_daughter_birth);
+    void finish(bool extinct);
+    bool isActive(){
+        return out != NULL;
+    }
+};
+
+struct EventRecord{
+    int kind;
+    // TYPE, KEY, cell records and DETACH; new type of a STEP
+    int type_index;
+    // TYPE and STEP, -1 for none
+    int parent;
+    bool is_root;
+    // KEY and cell records
+    int key;
+    double birth_rate;
+    long long num_cells;
+    // BEGIN and STEP
+    double time;
+    bool has_mutation;
+    double mother_birth;
+    double daughter_birth;
+    // END
+    bool extinct;
+};
+
+class EventLogReader{
+    /* reads the records of an event log in order, resolving keys to their type and birth rate.
+     */
+private:
+    FILE *file;
+    int max_types;
+    vector<int> key_types;
+    vector<double> key_rates;
+    long long time_bits;
+    double mother_birth;
+    double daughter_birth;
+    bool readVarint(unsigned long long& value);
+    bool readDouble(double& value);
+public:
+    EventLogReader();
+    ~EventLogReader();
+    bool open(const string& filename);
+    void close();
+    int getMaxTypes(){
+        return max_types;
+    }
+    // @return false at the end of the file, or if it ends in the middle of a record
+    bool next(EventRecord& record);
+    // @return kind of the next record without reading it, or 0 at the end of the file
+    int peekKind();
+};
+
+#endif /* EventLog_h */
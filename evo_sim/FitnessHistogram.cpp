@@ -0,0 +1,142 @@
+//
+//  FitnessHistogram.cpp
+//  evo_sim
+//
+//  Histogram of cell birth rates kept up to date as cells are born and die.
+//
+
+#include "FitnessHistogram.h"
+#include <cmath>
+
+FitnessHistogram::FitnessHistogram(){
+    type = -1;
+    min_rate = 0;
+    max_rate = 0;
+    bin_width = 0;
+    setRelative(0.01);
+}
+
+void FitnessHistogram::setFixed(int num_bins, double new_min, double new_max){
+    mode = FIXED;
+    min_rate = new_min;
+    max_rate = new_max;
+    bin_width = (max_rate - min_rate) / num_bins;
+    bins.assign(num_bins, 0);
+    clear();
+}
+
+void FitnessHistogram::setRelative(double accuracy){
+    mode = RELATIVE;
+    gamma = (1 + accuracy) / (1 - accuracy);
+    log_gamma = log(gamma);
+    bins.clear();
+    clear();
+}
+
+void FitnessHistogram::clear(){
+    if (mode == FIXED){
+        bins.assign(bins.size(), 0);
+    }
+    else{
+        bins.clear();
+        first_bin = 0;
+    }
+    underflow = 0;
+    overflow = 0;
+    non_positive = 0;
+    total = 0;
+    sum = 0;
+    stale = false;
+}
+
+void FitnessHistogram::add(double b, long long num){
+    total += num;
+    sum += b * num;
+    if (mode == FIXED){
+        if (b < min_rate){
+            underflow += num;
+        }
+        else if (b >= max_rate){
+            overflow += num;
+        }
+        else{
+            int i = int((b - min_rate) / bin_width);
+            bins[i < int(bins.size()) ? i : int(bins.size()) - 1] += num;
+        }
+        return;
+    }
+    if (b <= 0){
+        non_positive += num;
+        return;
+    }
+    int k = int(floor(log(b) / log_gamma + 0.5));
+    if (bins.empty()){
+        first_bin = k;
+    }
+    if (k < first_bin){
+        bins.insert(bins.begin(), first_bin - k, 0);
+        first_bin = k;
+    }
+    if (k - first_bin >= int(bins.size())){
+        bins.resize(k - first_bin + 1, 0);
+    }
+    bins[k - first_bin] += num;
+}
+
+void FitnessHistogram::merge(const FitnessHistogram& other){
+    total += other.total;
+    sum += other.sum;
+    underflow += other.underflow;
+    overflow += other.overflow;
+    non_positive += other.non_positive;
+    if (mode == FIXED){
+        for (int i=0; i<int(bins.size()) && i<int(other.bins.size()); i++){
+            bins[i] += other.bins[i];
+        }
+        return;
+    }
+    if (other.bins.empty()){
+        return;
+    }
+    if (bins.empty()){
+        bins = other.bins;
+        first_bin = other.first_bin;
+        return;
+    }
+    if (other.first_bin < first_bin){
+        bins.insert(bins.begin(), first_bin - other.first_bin, 0);
+        first_bin = other.first_bin;
+    }
+    int offset = other.first_bin - first_bin;
+    if (offset + int(other.bins.size()) > int(bins.size())){
+        bins.resize(offset + other.bins.size(), 0);
+    }
+    for (int i=0; i<int(other.bins.size()); i++){
+        bins[offset + i] += other.bins[i];
+    }
+}
+
+double FitnessHistogram::binRate(int i){
+    if (mode == FIXED){
+        return min_rate + (i + 0.5) * bin_width;
+    }
+    return pow(gamma, i + first_bin);
+}
+
+double FitnessHistogram::quantile(double q){
+    if (total <= 0){
+        return 0;
+    }
+    long long rank = (long long)(q * (total - 1));
+    long long seen = mode == FIXED ? underflow : non_positive;
+    if (rank < seen){
+        return mode == FIXED ? min_rate : 0;
+    }
+    for (int i=0; i<int(bins.size()); i++){
+        seen += bins[i];
+        if (rank < seen){
+            return binRate(i);
+        }
+    }
+    return max_rate;
+}
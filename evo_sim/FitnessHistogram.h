@@ -0,0 +1,104 @@
+//
+//  FitnessHistogram.hpp
+//  evo_sim
+//
+//  Histogram of cell birth rates kept up to date as cells are born and die.
+//
+
+#ifndef FitnessHistogram_h
+#define FitnessHistogram_h
+
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+class FitnessHistogram{
+    /* counts cells by birth rate, either in a fixed number of equal bins over a range (plus one bin on each side for rates outside it),
+     or in logarithmic bins that grow as needed so any quantile is within a relative accuracy of the true birth rate.
+     cells can be added and removed in any order, so the CList updates it at every birth and death rather than a writer walking every clone.
+     */
+public:
+    enum Mode {FIXED, RELATIVE};
+private:
+    Mode mode;
+    // type index of the cells counted, or -1 for every type
+    int type;
+    // FIXED: bins over [min_rate, max_rate)
+    double min_rate;
+    double max_rate;
+    double bin_width;
+    long long underflow;
+    long long overflow;
+    // RELATIVE: bins[i] counts rates within a factor sqrt(gamma) of gamma^(i+first_bin)
+    double gamma;
+    double log_gamma;
+    int first_bin;
+    // rates of zero or less, which have no logarithmic bin
+    long long non_positive;
+    vector<long long> bins;
+    long long total;
+    double sum;
+    bool stale;
+    // @return representative rate of bin i
+    double binRate(int i);
+public:
+    FitnessHistogram();
+    void setFixed(int num_bins, double new_min, double new_max);
+    // @param accuracy relative error of quantiles, in (0, 1)
+    void setRelative(double accuracy);
+    Mode getMode(){
+        return mode;
+    }
+    int getType(){
+        return type;
+    }
+    void setType(int new_type){
+        type = new_type;
+    }
+
+    // @param num cells added with birth rate b, negative to remove cells
+    void add(double b, long long num);
+    // adds the counts of other, which must have the same mode and bins (or accuracy)
+    void merge(const FitnessHistogram& other);
+    void clear();
+    // called when cells leave without being removed one by one (CellType::detachClones). the counts must be rebuilt before they are used.
+    void markStale(){
+        clear();
+        stale = true;
+    }
+    bool isStale(){
+        return stale;
+    }
+    void setFresh(){
+        stale = false;
+    }
+
+    long long getTotal(){
+        return total;
+    }
+    double getMean(){
+        return total > 0 ? sum / total : 0;
+    }
+    // @return birth rate below which a fraction q of cells lie, to the resolution of the bins
+    double quantile(double q);
+
+    int getNumBins(){
+        return int(bins.size());
+    }
+    long long getBin(int i){
+        return bins[i];
+    }
+    long long getUnderflow(){
+        return underflow;
+    }
+    long long getOverflow(){
+        return overflow;
+    }
+    // FIXED only: lower edge of bin i, or the upper edge of the range for i == number of bins
+    double getEdge(int i){
+        return min_rate + i * bin_width;
+    }
+};
+
+#endif /* FitnessHistogram_h */
@@ -10,9 +10,12 @@
 #include "main.h"
 #include "CList.h"
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
 #include <vector>
 #include <string>
 #include <random>
+#include <cmath>
 
 using namespace std;
 
@@ -58,90 +61,128 @@ CellType* MutationHandler::getNewTypeByIndex(int index, CellType& curr_type){
     }
 }
 
+void MutationHandler::applyOutcome(const MutationOutcome& outcome, CellType& type, double b, double mut){
+    new_type = getNewTypeByIndex(outcome.type_index, type);
+    birth_rate = outcome.birth_scale * b + outcome.birth_shift;
+    mut_prob = outcome.mut_scale * mut + outcome.mut_shift;
+    has_mutated = outcome.has_mutated;
+}
+
+MutationOutcome MutationHandler::makeOutcome(int type_index, double birth_scale, double birth_shift, double mut_scale, double mut_shift){
+    MutationOutcome outcome;
+    outcome.type_index = type_index;
+    outcome.birth_scale = birth_scale;
+    outcome.birth_shift = birth_shift;
+    outcome.mut_scale = mut_scale;
+    outcome.mut_shift = mut_shift;
+    outcome.has_mutated = true;
+    return outcome;
+}
+
+TransitionTable::TransitionTable(){
+    row_start.push_back(0);
+}
+
+void TransitionTable::clear(){
+    row_start.clear();
+    row_start.push_back(0);
+    outcomes.clear();
+    prob.clear();
+    alias.clear();
+}
+
+void TransitionTable::addEmptyRow(){
+    row_start.push_back(int(outcomes.size()));
+}
+
+void TransitionTable::addRow(const vector<MutationOutcome>& row_outcomes, const vector<double>& weights){
+    int begin = int(outcomes.size());
+    vector<double> kept;
+    for (size_t i=0; i<row_outcomes.size(); i++){
+        if (weights[i] > 0){
+            outcomes.push_back(row_outcomes[i]);
+            kept.push_back(weights[i]);
+        }
+    }
+    int num = int(kept.size());
+    prob.resize(begin + num);
+    alias.resize(begin + num);
+    if (num > 0){
+        AliasTable::buildInto(kept.data(), num, &prob[begin], &alias[begin], small_work, large_work);
+    }
+    row_start.push_back(begin + num);
+}
+
 void ThreeTypesMutation::generateMutant(CellType& type, double b, double mut){
-    if (!(type.getIndex() <= 1)){
+    const MutationOutcome *outcome = transitions.draw(type.getIndex(), *eng);
+    if (!outcome){
         throw "bad three types mutating cell type";
     }
-    if (type.getIndex() == 1){
-        birth_rate = b + fit2 - fit1 - 1;
-        mut_prob = 0;
-        new_type = getNewTypeByIndex(2, type);
-    }
-    else if (type.getIndex() == 0){
-        birth_rate = b + fit1 - 1;
-        mut_prob = mu2;
-        new_type = getNewTypeByIndex(1, type);
-    }
-    has_mutated = true;
+    applyOutcome(*outcome, type, b, mut);
 }
 
 void ThreeTypesFlexMutation::generateMutant(CellType& type, double b, double mut){
-    if (!(type.getIndex() <= 1)){
+    const MutationOutcome *outcome = transitions.draw(type.getIndex(), *eng);
+    if (!outcome){
         throw "bad three types mutating cell type";
     }
-    if (type.getIndex() == 1){
-        birth_rate = fit2;
-        mut_prob = 0;
-        new_type = getNewTypeByIndex(2, type);
-    }
-    else if (type.getIndex() == 0){
-        uniform_real_distribution<double> runif;
-        double which_trans = runif(*eng);
-        if (which_trans < p1){
-            birth_rate = fit2;
-            mut_prob = 0;
-            new_type = getNewTypeByIndex(2, type);
-        }
-        else{
-            birth_rate = fit1;
-            mut_prob = mu2;
-            new_type = getNewTypeByIndex(1, type);
-        }
-    }
-    has_mutated = true;
+    applyOutcome(*outcome, type, b, mut);
 }
 
 void ManyTypesFlexMutation::generateMutant(CellType& type, double b, double mut){
-    if (floor(type.getIndex()/num_types) == 1){
-        birth_rate = fit2;
-        mut_prob = 0;
-        new_type = getNewTypeByIndex(2, type);
-    }
-    else if (floor(type.getIndex()/num_types) == 0){
-        uniform_real_distribution<double> runif;
-        double which_trans = runif(*eng);
-        if (which_trans < p1){
-            birth_rate = fit2;
-            mut_prob = 0;
-            new_type = getNewTypeByIndex(2*num_types + type.getIndex(), type);
-        }
-        else{
-            birth_rate = fit1;
-            mut_prob = mu2;
-            new_type = getNewTypeByIndex(num_types + type.getIndex(), type);
-        }
-    }
-    else{
+    const MutationOutcome *outcome = transitions.draw(type.getIndex(), *eng);
+    if (!outcome){
         throw "bad mutating cell type";
     }
-    has_mutated = true;
+    applyOutcome(*outcome, type, b, mut);
 }
 
-void ThreeTypesMultMutation::generateMutant(CellType& type, double b, double mut){
-    if (!(type.getIndex() <= 1)){
-        throw "bad three types mutating cell type";
-    }
-    if (type.getIndex() == 1){
-        birth_rate = b*fit2/fit1;
-        mut_prob = 0;
-        new_type = getNewTypeByIndex(2, type);
-    }
-    else if (type.getIndex() == 0){
-        birth_rate = b*fit1;
-        mut_prob = mu2;
-        new_type = getNewTypeByIndex(1, type);
+void ThreeTypesMutation::compile(){
+    // type 0 -> 1 -> 2, with additive fitness changes
+    transitions.clear();
+    vector<double> certain(1, 1.0);
+    transitions.addRow(vector<MutationOutcome>(1, makeOutcome(1, 1, fit1 - 1, 0, mu2)), certain);
+    transitions.addRow(vector<MutationOutcome>(1, makeOutcome(2, 1, fit2 - fit1 - 1, 0, 0)), certain);
+}
+
+void ThreeTypesMultMutation::compile(){
+    transitions.clear();
+    vector<double> certain(1, 1.0);
+    transitions.addRow(vector<MutationOutcome>(1, makeOutcome(1, fit1, 0, 0, mu2)), certain);
+    transitions.addRow(vector<MutationOutcome>(1, makeOutcome(2, fit2/fit1, 0, 0, 0)), certain);
+}
+
+void ThreeTypesFlexMutation::compile(){
+    // type 0 goes straight to type 2 with probability p1. fitnesses are absolute.
+    transitions.clear();
+    vector<MutationOutcome> from_0;
+    vector<double> weights;
+    from_0.push_back(makeOutcome(2, 0, fit2, 0, 0));
+    weights.push_back(fmin(1.0, fmax(0.0, p1)));
+    from_0.push_back(makeOutcome(1, 0, fit1, 0, mu2));
+    weights.push_back(1 - weights[0]);
+    transitions.addRow(from_0, weights);
+    transitions.addRow(vector<MutationOutcome>(1, makeOutcome(2, 0, fit2, 0, 0)), vector<double>(1, 1.0));
+}
+
+void ManyTypesFlexMutation::compile(){
+    // types [0, num_types) are unmutated, [num_types, 2*num_types) have one hit
+    transitions.clear();
+    vector<MutationOutcome> row;
+    vector<double> weights;
+    double direct = fmin(1.0, fmax(0.0, p1));
+    for (int i=0; i<num_types; i++){
+        row.clear();
+        weights.clear();
+        row.push_back(makeOutcome(2*num_types + i, 0, fit2, 0, 0));
+        weights.push_back(direct);
+        row.push_back(makeOutcome(num_types + i, 0, fit1, 0, mu2));
+        weights.push_back(1 - direct);
+        transitions.addRow(row, weights);
+    }
+    for (int i=0; i<num_types; i++){
+        transitions.addRow(vector<MutationOutcome>(1, makeOutcome(2, 0, fit2, 0, 0)), vector<double>(1, 1.0));
     }
-    has_mutated = true;
 }
 
 void NeutralMutation::generateMutant(CellType& type, double b, double mut){
@@ -283,115 +324,133 @@ bool ManyTypesFlexMutation::read(std::vector<string>& params){
 }
 
 FixedSitesMutation::FixedSitesMutation() : MutationHandler(){
-    fitnesses = NULL;
-    adj_mat = NULL;
     max_types = 0;
     is_mult = false;
 }
 
-FixedSitesMutation::~FixedSitesMutation(){
-    if (fitnesses){
-        delete fitnesses;
-    }
-    if (adj_mat){
-        delete adj_mat;
-    }
-}
-
 bool FixedSitesMutation::read(std::vector<string>& params){
     // syntax: sim_params mut_handler_params [max types] [is mult (integer to bool)] [fitnesses file name] [adj matrix file name]
+    // each line of the adjacency file lists the types that type (line number) can mutate to, e.g. 3,7,12 or weighted 3:0.5,7:2,12:1
     
     if (!(params.size() == 4)){
         return false;
     }
-    max_types = stoi(params[0]);
-    fitnesses = new double[max_types];
-    adj_mat = new int[max_types * max_types];
-    
-    is_mult = stoi(params[1]);
-    
+    try{
+        max_types = stoi(params[0]);
+        is_mult = stoi(params[1]);
+    }
+    catch (...){
+        return false;
+    }
+    if (max_types <= 0){
+        return false;
+    }
+    return readFitnesses(params[2]) && readNetwork(params[3]);
+}
+
+bool FixedSitesMutation::readFitnesses(string filename){
     ifstream infile;
-    infile.open(params[2]);
+    infile.open(filename);
     if (!infile.is_open()){
         return false;
     }
+    fitnesses.clear();
+    fitnesses.reserve(max_types);
     string line;
-    int count_type = 0;
     while (getline(infile, line)){
-        try{
-            fitnesses[count_type] = stod(line);
-        }
-        catch(...){
+        const char *start = line.c_str();
+        char *end;
+        double fitness = strtod(start, &end);
+        if (end == start || int(fitnesses.size()) == max_types){
             return false;
         }
-        count_type ++;
+        fitnesses.push_back(fitness);
     }
-    if (count_type != max_types){
+    return int(fitnesses.size()) == max_types;
+}
+
+bool FixedSitesMutation::readNetwork(string filename){
+    ifstream infile;
+    infile.open(filename);
+    if (!infile.is_open()){
         return false;
     }
+    row_start.clear();
+    targets.clear();
+    prob.clear();
+    alias.clear();
+    row_start.reserve(max_types + 1);
+    row_start.push_back(0);
     
-    ifstream infile2;
-    infile2.open(params[3]);
-    if (!infile2.is_open()){
-        return false;
-    }
-    count_type = 0;
-    while (getline(infile2, line)){
-        std::stringstream ss;
-        string tok;
-        ss.str(line);
-        int count_line = 0;
-        try{
-            while (getline(ss, tok, ',')){
-                int to_add = stoi(tok);
-                if (to_add > max_types){
+    // one line at a time, so only the current row's weights are held besides the CSR arrays
+    vector<double> row_weights;
+    vector<int> small_work;
+    vector<int> large_work;
+    string line;
+    while (getline(infile, line)){
+        if (int(row_start.size()) > max_types){
+            return false;
+        }
+        row_weights.clear();
+        const char *curr = line.c_str();
+        while (*curr != '\0'){
+            char *end;
+            long target = strtol(curr, &end, 10);
+            if (end == curr || target >= max_types){
+                return false;
+            }
+            curr = end;
+            double weight = 1;
+            if (*curr == ':'){
+                curr++;
+                weight = strtod(curr, &end);
+                if (end == curr || weight < 0){
                     return false;
                 }
-                adj_mat[getAdjIndex(count_type, count_line)] = to_add;
-                count_line ++;
+                curr = end;
+            }
+            while (*curr == ' ' || *curr == '\r'){
+                curr++;
+            }
+            if (*curr == ','){
+                curr++;
+            }
+            else if (*curr != '\0'){
+                return false;
             }
-            for (int i=count_line; i<max_types; i++){
-                adj_mat[getAdjIndex(count_type, i)] = -1;
+            // negative ids pad rows that have fewer edges than others
+            if (target >= 0 && weight > 0){
+                targets.push_back(int(target));
+                row_weights.push_back(weight);
             }
         }
-        catch(...){
-            return false;
+        int begin = row_start.back();
+        int num = int(row_weights.size());
+        prob.resize(begin + num);
+        alias.resize(begin + num);
+        if (num > 0){
+            AliasTable::buildInto(row_weights.data(), num, &prob[begin], &alias[begin], small_work, large_work);
         }
-        count_type ++;
+        row_start.push_back(begin + num);
     }
-    if (count_type > max_types){
-        return false;
+    // types without a line cannot mutate
+    while (int(row_start.size()) <= max_types){
+        row_start.push_back(row_start.back());
     }
-    for (int i=count_type; i<max_types; i++){
-        for (int j=0; j<max_types; j++){
-            adj_mat[getAdjIndex(i, j)] = -1;
-        }
-    }
-
     return true;
 }
 
-int FixedSitesMutation::getAdjIndex(int cell_type, int adj_type){
-    return cell_type * max_types + adj_type;
-}
-
 void FixedSitesMutation::generateMutant(CellType &type, double b, double mut){
-    int count_new = 0;
     int orig_type_id = type.getIndex();
-    for (int i=0; i<max_types; i++){
-        if (adj_mat[getAdjIndex(orig_type_id, i)] > 0){
-            count_new ++;
-        }
-    }
-    if (count_new == 0){
+    int begin = row_start[orig_type_id];
+    int num = row_start[orig_type_id + 1] - begin;
+    if (num == 0){
         birth_rate = b;
         mut_prob = 0;
         new_type = &type;
         return;
     }
-    uniform_real_distribution<double> runif;
-    double which_trans = count_new * runif(*eng);
-    int new_type_id = adj_mat[getAdjIndex(orig_type_id, floor(which_trans))];
+    int new_type_id = targets[begin + AliasTable::sampleFrom(&prob[begin], &alias[begin], num, *eng)];
     new_type = getNewTypeByIndex(new_type_id, type);
     mut_prob = mut;
     if (is_mult){
@@ -405,6 +464,18 @@ void FixedSitesMutation::generateMutant(CellType &type, double b, double mut){
 
 SexReprMutation::SexReprMutation() : MutationHandler(){}
 
+void SexReprMutation::generateMutant(CellType& mother_type, CellType& father_type, double b, double mut){
+    SexReprOffspring child;
+    drawOffspring(mother_type.getIndex(), father_type.getIndex(), b, mut, child);
+    if (child.type_index < 0){
+        throw "bad parent types for sexual reproduction";
+    }
+    new_type = getNewTypeByIndex(child.type_index, mother_type);
+    birth_rate = child.birth_rate;
+    mut_prob = child.mut_prob;
+    has_mutated = child.has_mutated;
+}
+
 FathersCurseMutation::FathersCurseMutation() : SexReprMutation(){
     f_AA = -1;
     f_Aa = -1;
@@ -436,155 +507,87 @@ FathersCurseMutation::FathersCurseMutation() : SexReprMutation(){
  8: aa Xy
  */
 
-void FathersCurseMutation::generateMutant(CellType& mother_type, CellType& father_type, double b, double mut){
-    uniform_real_distribution<double> runif;
-    
-    string autosome_genotype = "error";
-    if (mother_type.getIndex() == 0){
-        switch (father_type.getIndex()){
-            case 3: case 6:
-                autosome_genotype = "AA";
-                break;
-            case 4: case 7:
-                if (runif(*eng) < 0.5){
-                    autosome_genotype = "AA";
-                }
-                else{
-                    autosome_genotype = "Aa";
-                }
-                break;
-            case 5: case 8:
-                autosome_genotype = "Aa";
-                break;
-        }
-    }
-    else if (mother_type.getIndex() == 1){
-        double ran_num = runif(*eng);
-        switch (father_type.getIndex()){
-            case 3: case 6:
-                if (ran_num < 0.5){
-                    autosome_genotype = "AA";
-                }
-                else{
-                    autosome_genotype = "Aa";
-                }
-                break;
-            case 4: case 7:
-
-                if (ran_num < 0.25){
-                    autosome_genotype = "AA";
-                }
-                else if (ran_num < 0.75){
-                    autosome_genotype = "Aa";
-                }
-                else{
-                    autosome_genotype = "aa";
-                }
-                break;
-            case 5: case 8:
-                if (ran_num < 0.5){
-                    autosome_genotype = "aa";
-                }
-                else{
-                    autosome_genotype = "Aa";
-                }
-                break;
-        }
-    }
-    else if (mother_type.getIndex() == 2){
-        switch (father_type.getIndex()){
-            case 3: case 6:
-                autosome_genotype = "Aa";
-                break;
-            case 4: case 7:
-                if (runif(*eng) < 0.5){
-                    autosome_genotype = "aa";
-                }
-                else{
-                    autosome_genotype = "Aa";
-                }
-                break;
-            case 5: case 8:
-                autosome_genotype = "aa";
-                break;
-        }
-    }
-    else{
-        cout << "bad mother type";
-    }
-    
-    has_mutated = runif(*eng) < autosome_mut;
-    if (has_mutated){
-        if (autosome_genotype == "AA"){
-            autosome_genotype = "Aa";
-        }
-        else if (autosome_genotype == "Aa"){
-            if (runif(*eng) < 0.5){
-                autosome_genotype = "AA";
-            }
-            else{
-                autosome_genotype = "aa";
-            }
-        }
-        else if (autosome_genotype == "aa"){
-            autosome_genotype = "Aa";
-        }
+void FathersCurseMutation::drawOffspring(int mother_index, int father_index, double b, double mut, SexReprOffspring& child){
+    const MutationOutcome *outcome = NULL;
+    if (father_index >= 0 && father_index < NUM_TYPES){
+        outcome = transitions.draw(getRow(mother_index, father_index), *eng);
+    }
+    if (!outcome){
+        child.type_index = -1;
+        child.birth_rate = b;
+        child.mut_prob = mut;
+        child.has_mutated = false;
+        return;
     }
+    child.type_index = outcome->type_index;
+    child.birth_rate = outcome->birth_scale * b + outcome->birth_shift;
+    child.mut_prob = outcome->mut_scale * mut + outcome->mut_shift;
+    child.has_mutated = outcome->has_mutated;
+}
+
+void FathersCurseMutation::compile(){
+    // every offspring outcome for each pair of parents: Mendelian inheritance of the autosome, then an autosome mutation, a Y mutation, and the sex
+    double fit[3] = {f_AA, f_Aa, f_aa};
+    double fit_y[3] = {f_AA_y, f_Aa_y, f_aa_y};
+    double p_auto = fmin(1.0, autosome_mut);
+    double p_y = fmin(1.0, y_mut);
+    double p_male = fmin(1.0, male_prob);
     
-    bool has_mutated_y = runif(*eng) < y_mut;
-    bool is_male = runif(*eng) < male_prob;
-    if (autosome_genotype == "AA"){
-        if (is_male){
-            if ((father_type.getIndex() <= 5 && !has_mutated_y) || (father_type.getIndex() > 5 && has_mutated_y)){
-                new_type = getNewTypeByIndex(3, mother_type);
-                birth_rate = f_AA;
-            }
-            else{
-                new_type = getNewTypeByIndex(6, mother_type);
-                birth_rate = f_AA_y;
+    transitions.clear();
+    vector<MutationOutcome> row;
+    vector<double> weights;
+    for (int mother=0; mother<NUM_TYPES; mother++){
+        for (int father=0; father<NUM_TYPES; father++){
+            if (mother > 2 || father < 3){
+                transitions.addEmptyRow();
+                continue;
             }
-        }
-        else{
-            new_type = getNewTypeByIndex(0, mother_type);
-            birth_rate = f_AA;
-        }
-    }
-    else if (autosome_genotype == "Aa"){
-        if (is_male){
-            if ((father_type.getIndex() <= 5 && !has_mutated_y) || (father_type.getIndex() > 5 && has_mutated_y)){
-                new_type = getNewTypeByIndex(4, mother_type);
-                birth_rate = f_Aa;
-            }
-            else{
-                new_type = getNewTypeByIndex(7, mother_type);
-                birth_rate = f_Aa_y;
-            }
-        }
-        else{
-            new_type = getNewTypeByIndex(1, mother_type);
-            birth_rate = f_Aa;
-        }
-    }
-    else if (autosome_genotype == "aa"){
-        if (is_male){
-            if ((father_type.getIndex() <= 5 && !has_mutated_y) || (father_type.getIndex() > 5 && has_mutated_y)){
-                new_type = getNewTypeByIndex(5, mother_type);
-                birth_rate = f_aa;
-            }
-            else{
-                new_type = getNewTypeByIndex(8, mother_type);
-                birth_rate = f_aa_y;
+            // chance each parent passes on a, and the resulting genotype (number of a alleles)
+            double mother_a = mother * 0.5;
+            double father_a = ((father - 3) % 3) * 0.5;
+            double inherited[3];
+            inherited[0] = (1 - mother_a) * (1 - father_a);
+            inherited[1] = mother_a * (1 - father_a) + (1 - mother_a) * father_a;
+            inherited[2] = mother_a * father_a;
+            // sons keep the father's Y unless it mutates
+            double keeps_y = (father <= 5) ? 1 - p_y : p_y;
+            
+            row.clear();
+            weights.clear();
+            for (int genotype=0; genotype<3; genotype++){
+                for (int mutated=0; mutated<2; mutated++){
+                    double p_genotype = inherited[genotype] * (mutated ? p_auto : 1 - p_auto);
+                    // a mutation turns AA or aa into Aa, and Aa into AA or aa with equal chance
+                    double final_prob[3] = {0, 0, 0};
+                    if (!mutated){
+                        final_prob[genotype] = 1;
+                    }
+                    else if (genotype == 1){
+                        final_prob[0] = 0.5;
+                        final_prob[2] = 0.5;
+                    }
+                    else{
+                        final_prob[1] = 1;
+                    }
+                    for (int g=0; g<3; g++){
+                        double p = p_genotype * final_prob[g];
+                        MutationOutcome outcome = makeOutcome(g, 0, fit[g], 1, 0);
+                        outcome.has_mutated = mutated;
+                        row.push_back(outcome);
+                        weights.push_back(p * (1 - p_male));
+                        outcome.type_index = 3 + g;
+                        row.push_back(outcome);
+                        weights.push_back(p * p_male * keeps_y);
+                        outcome.type_index = 6 + g;
+                        outcome.birth_shift = fit_y[g];
+                        row.push_back(outcome);
+                        weights.push_back(p * p_male * (1 - keeps_y));
+                    }
+                }
             }
+            transitions.addRow(row, weights);
         }
-        else{
-            new_type = getNewTypeByIndex(2, mother_type);
-            birth_rate = f_aa;
-        }
-    }
-    else{
-        cout << "bad father type";
     }
-    mut_prob = mut;
 }
 
 bool FathersCurseMutation::read(std::vector<string>& params){
@@ -641,3 +644,206 @@ bool FathersCurseMutation::read(std::vector<string>& params){
     
     return true;
 }
+
+// floor of additive Hypercube fitnesses
+static const double MIN_FITNESS = 1e-6;
+
+HypercubeMutation::HypercubeMutation() : MutationHandler(){
+    num_loci = 0;
+    is_nk = true;
+    k = 0;
+    effect = 0;
+    epistasis = 0;
+    seed = 0;
+    is_mult = true;
+    cache_size = 1 << 20;
+}
+
+bool HypercubeMutation::read(std::vector<string>& params){
+    /*
+     Format for Hypercube params line:
+     sim_params mut_handler_params loci,## [model,nk k,##] [model,additive effect,## epistasis,##] seed,## cache,## mult,##
+     loci (at most 64) is required. the model defaults to nk with k,0, seed to 0 (every simulation thread uses the same landscape for a seed), cache to 2^20 fitnesses, and mult to 1.
+     mult,1 scales the birth rate by the ratio of new to old fitness, mult,0 adds the difference.
+     additive fitnesses below MIN_FITNESS (for example when the effects of the mutated loci sum to -1 or less) are raised to it, so the ratio is always finite and positive,
+     and a birth rate that mult,0 would make negative is 0.
+     */
+    string pre;
+    string post;
+    for (int i=0; i<int(params.size()); i++){
+        string tok = params[i];
+        stringstream ss;
+        ss.str(tok);
+        getline(ss, pre, ',');
+        if (!getline(ss, post)){
+            return false;
+        }
+        try{
+            if (pre=="loci"){
+                num_loci = stoi(post);
+            }
+            else if (pre=="model"){
+                if (post == "nk"){
+                    is_nk = true;
+                }
+                else if (post == "additive"){
+                    is_nk = false;
+                }
+                else{
+                    return false;
+                }
+            }
+            else if (pre=="k"){
+                k = stoi(post);
+            }
+            else if (pre=="effect"){
+                effect = stod(post);
+            }
+            else if (pre=="epistasis"){
+                epistasis = stod(post);
+            }
+            else if (pre=="seed"){
+                seed = stoull(post);
+            }
+            else if (pre=="cache"){
+                cache_size = stoi(post);
+            }
+            else if (pre=="mult"){
+                is_mult = stoi(post);
+            }
+            else{
+                return false;
+            }
+        }
+        catch (...){
+            return false;
+        }
+    }
+    if (num_loci < 1 || num_loci > 64 || k < 0 || k >= num_loci || cache_size < 1){
+        return false;
+    }
+    cache_genotypes.assign(cache_size, 0);
+    cache_fitnesses.assign(cache_size, 0);
+    cache_full.assign(cache_size, false);
+    return true;
+}
+
+void HypercubeMutation::refresh(){
+    type_genotypes.clear();
+    has_genotype.clear();
+    genotype_types.clear();
+}
+
+unsigned long long HypercubeMutation::splitmix64(unsigned long long x){
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+double HypercubeMutation::hashUnit(unsigned long long key1, unsigned long long key2){
+    unsigned long long h = splitmix64(splitmix64(seed ^ splitmix64(key1)) ^ key2);
+    return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double HypercubeMutation::computeFitness(unsigned long long genotype){
+    if (is_nk){
+        // mean over loci of a random contribution determined by the locus and the alleles of it and its k neighbours
+        double total = 0;
+        for (int i=0; i<num_loci; i++){
+            unsigned long long neighbourhood = 0;
+            for (int j=0; j<=k; j++){
+                int locus = (i + j) % num_loci;
+                neighbourhood |= ((genotype >> locus) & 1ULL) << j;
+            }
+            total += hashUnit(i, neighbourhood);
+        }
+        return total / num_loci;
+    }
+    // 1 plus the effects of every mutated locus and every pair of mutated loci
+    double fitness = 1;
+    for (int i=0; i<num_loci; i++){
+        if (!((genotype >> i) & 1ULL)){
+            continue;
+        }
+        fitness += effect * (2 * hashUnit(i, i) - 1);
+        if (epistasis != 0){
+            for (int j=i+1; j<num_loci; j++){
+                if ((genotype >> j) & 1ULL){
+                    fitness += epistasis * (2 * hashUnit(i, j) - 1);
+                }
+            }
+        }
+    }
+    return fitness < MIN_FITNESS ? MIN_FITNESS : fitness;
+}
+
+double HypercubeMutation::getFitness(unsigned long long genotype){
+    int slot = int(splitmix64(genotype) % (unsigned long long)cache_size);
+    if (cache_full[slot] && cache_genotypes[slot] == genotype){
+        return cache_fitnesses[slot];
+    }
+    double fitness = computeFitness(genotype);
+    cache_full[slot] = true;
+    cache_genotypes[slot] = genotype;
+    cache_fitnesses[slot] = fitness;
+    return fitness;
+}
+
+unsigned long long HypercubeMutation::getGenotype(int type_id){
+    if (type_id < int(has_genotype.size()) && has_genotype[type_id]){
+        return type_genotypes[type_id];
+    }
+    // a type from the input file
+    if (type_id >= int(has_genotype.size())){
+        has_genotype.resize(type_id + 1, false);
+        type_genotypes.resize(type_id + 1, 0);
+    }
+    has_genotype[type_id] = true;
+    type_genotypes[type_id] = 0;
+    if (genotype_types.find(0) == genotype_types.end()){
+        genotype_types[0] = type_id;
+    }
+    return 0;
+}
+
+void HypercubeMutation::generateMutant(CellType& type, double b, double mut){
+    unsigned long long parent_genotype = getGenotype(type.getIndex());
+    uniform_int_distribution<int> rlocus(0, num_loci - 1);
+    unsigned long long child_genotype = parent_genotype ^ (1ULL << rlocus(*eng));
+    
+    int child_id;
+    unordered_map<unsigned long long, int>::iterator found = genotype_types.find(child_genotype);
+    if (found != genotype_types.end()){
+        child_id = found->second;
+    }
+    else{
+        CList& clone_list = type.getPopulation();
+        if (clone_list.noTypesLeft()){
+            throw "tried to get new type when no types left";
+        }
+        child_id = clone_list.getNextType();
+        genotype_types[child_genotype] = child_id;
+        if (child_id >= int(has_genotype.size())){
+            has_genotype.resize(child_id + 1, false);
+            type_genotypes.resize(child_id + 1, 0);
+        }
+        has_genotype[child_id] = true;
+        type_genotypes[child_id] = child_genotype;
+    }
+    new_type = getNewTypeByIndex(child_id, type);
+    
+    double parent_fitness = getFitness(parent_genotype);
+    double child_fitness = getFitness(child_genotype);
+    if (is_mult){
+        birth_rate = b * child_fitness/parent_fitness;
+    }
+    else{
+        birth_rate = b + child_fitness - parent_fitness;
+        if (birth_rate < 0){
+            birth_rate = 0;
+        }
+    }
+    mut_prob = mut;
+    has_mutated = true;
+}
@@ -12,11 +12,66 @@
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <random>
+#include <unordered_map>
+#include "AliasTable.h"
 
 class CellType;
 
 using namespace std;
 
+struct MutationOutcome{
+    // one possible result of a mutation (or of sexual reproduction), applied to the parent's traits
+    int type_index;
+    // the new birth rate is birth_scale * (parent birth rate) + birth_shift
+    double birth_scale;
+    double birth_shift;
+    // the new mutation probability is mut_scale * (parent mutation probability) + mut_shift
+    double mut_scale;
+    double mut_shift;
+    bool has_mutated;
+};
+
+class TransitionTable{
+    /* mutation rules compiled into one alias table per row (usually the parent type id) over the outcomes reachable from that row.
+     rows are stored back to back in flat arrays, so drawing an outcome is a lookup plus at most one uniform draw.
+     read-only once built, so it may be shared between threads.
+     */
+private:
+    // outcomes, prob and alias of row r are at [row_start[r], row_start[r+1])
+    vector<int> row_start;
+    vector<MutationOutcome> outcomes;
+    vector<double> prob;
+    vector<int> alias;
+    vector<int> small_work;
+    vector<int> large_work;
+public:
+    TransitionTable();
+    void clear();
+    /* appends the next row. outcomes with zero weight are dropped.
+     @param row_outcomes every outcome of the row
+     @param weights probability (unnormalized) of each outcome
+     */
+    void addRow(const vector<MutationOutcome>& row_outcomes, const vector<double>& weights);
+    // adds a row with no outcomes
+    void addEmptyRow();
+    int numRows(){
+        return int(row_start.size()) - 1;
+    }
+    // @return outcome drawn for row, or NULL if row is out of range or has no outcomes
+    const MutationOutcome* draw(int row, std::mt19937& rng) const{
+        if (row < 0 || row + 1 >= int(row_start.size())){
+            return NULL;
+        }
+        int begin = row_start[row];
+        int num = row_start[row + 1] - begin;
+        if (num <= 1){
+            return (num == 1) ? &outcomes[begin] : NULL;
+        }
+        return &outcomes[begin + AliasTable::sampleFrom(&prob[begin], &alias[begin], num, rng)];
+    }
+};
+
 
 class MutationHandler {
     /* chooses new parameters (mutation prob, fitness, cell type) for a new cell type
@@ -28,6 +83,8 @@ protected:
     double mut_prob;
     bool has_mutated;
     CellType *new_type;
+    // filled in by compile() for handlers whose rules depend only on the parent type
+    TransitionTable transitions;
     
     /* gets the desired mutant type, either the existing type or creates a new type.
      @param index desired index of new type. SHOULD NOT be outside the range 0<=index<max_types of clone_list
@@ -36,6 +93,11 @@ protected:
      @return a cell type appropriate for the typespace in clone_list with the desired index. MUST BE DELETED LATER.
      */
     CellType* getNewTypeByIndex(int index, CellType& curr_type);
+    
+    // loads the new parameters from a compiled outcome
+    void applyOutcome(const MutationOutcome& outcome, CellType& type, double b, double mut);
+    // @return outcome with the given type and new birth rate = birth_scale * b + birth_shift
+    static MutationOutcome makeOutcome(int type_index, double birth_scale, double birth_shift, double mut_scale, double mut_shift);
 public:
     MutationHandler();
     
@@ -60,13 +122,35 @@ public:
      */
     virtual void generateMutant(CellType& type, double b, double mut) = 0;
     virtual bool read(std::vector<string>& params) = 0;
+    // precomputes whatever generateMutant needs from the parameters. called once, after read().
+    virtual void compile(){};
+    // called before every simulation after the first, once the population has been cleared
+    virtual void refresh(){};
+};
+
+struct SexReprOffspring{
+    // type id, birth rate, and mutation probability of one offspring, before it is placed in the population
+    int type_index;
+    double birth_rate;
+    double mut_prob;
+    bool has_mutated;
 };
 
 class SexReprMutation: public MutationHandler{
 public:
     SexReprMutation();
     void generateMutant(CellType& type, double b, double mut){};
-    virtual void generateMutant(CellType& mother_type, CellType& father_type, double b, double mut)=0;
+    // draws the offspring with drawOffspring and then creates/looks up its type in the population
+    virtual void generateMutant(CellType& mother_type, CellType& father_type, double b, double mut);
+    /* draws the inherited traits of one offspring without touching the population or this handler's state.
+     THREAD SAFE as long as each thread has its own eng- used to produce offspring in parallel.
+     @param mother_index type id of the mother
+     @param father_index type id of the father
+     @param b birth rate of the mother
+     @param mut mutation probability of the mother
+     @param child filled in with the offspring's traits
+     */
+    virtual void drawOffspring(int mother_index, int father_index, double b, double mut, SexReprOffspring& child) = 0;
     virtual bool read(std::vector<string>& params) = 0;
 };
 
@@ -82,10 +166,17 @@ private:
     double autosome_mut;
     double y_mut;
     double male_prob;
+    
+    // number of genotypes, and the row of transitions for a pair of parents
+    static const int NUM_TYPES = 9;
+    int getRow(int mother_index, int father_index){
+        return mother_index * NUM_TYPES + father_index;
+    }
 public:
     FathersCurseMutation();
-    void generateMutant(CellType& mother_type, CellType& father_type, double b, double mut);
+    void drawOffspring(int mother_index, int father_index, double b, double mut, SexReprOffspring& child);
     bool read(std::vector<string>& params);
+    void compile();
 };
 
 class ThreeTypesMutation: public MutationHandler {
@@ -103,6 +194,7 @@ public:
     ThreeTypesMutation(double m2, double f1, double f2);
     virtual void generateMutant(CellType& type, double b, double mut);
     bool read(std::vector<string>& params);
+    virtual void compile();
 };
 
 class ThreeTypesFlexMutation: public MutationHandler {
@@ -117,6 +209,7 @@ public:
     ThreeTypesFlexMutation(double m2, double f1, double f2, double pr1);
     virtual void generateMutant(CellType& type, double b, double mut);
     bool read(std::vector<string>& params);
+    void compile();
 };
 
 class ManyTypesFlexMutation: public MutationHandler {
@@ -132,12 +225,13 @@ public:
     ManyTypesFlexMutation(double m2, double f1, double f2, double pr1, int ntypes);
     virtual void generateMutant(CellType& type, double b, double mut);
     bool read(std::vector<string>& params);
+    void compile();
 };
 
 class ThreeTypesMultMutation: public ThreeTypesMutation{
 public:
     ThreeTypesMultMutation(){};
-    virtual void generateMutant(CellType& type, double b, double mut);
+    void compile();
 };
 
 class NeutralMutation: public MutationHandler{
@@ -156,18 +250,88 @@ public:
     }
 };
 
+class ReplayMutation: public MutationHandler{
+    /* stands in for the recorded simulation's handler while ReplayPop replays an event log, holding the mutation of the current step.
+     */
+public:
+    ReplayMutation(){};
+    bool read(std::vector<string>& params){return true;};
+    void generateMutant(CellType& type, double b, double mut){
+        throw "should not be mutating- replaying recorded events";
+    }
+    void setMutant(CellType& type, double b){
+        new_type = &type;
+        birth_rate = b;
+        mut_prob = 0;
+        has_mutated = true;
+    }
+};
+
 class FixedSitesMutation: public MutationHandler {
+    /* mutations move between a fixed set of genotypes (types) along a mutational network read from a file.
+     the network is stored as compressed sparse rows, with one alias table per row over its (possibly weighted) edges, so memory grows with the number of edges and choosing a mutant is O(1).
+     */
 private:
-    int getAdjIndex(int cell_type, int adj_type);
     int max_types;
-    double* fitnesses;
-    int* adj_mat;
+    vector<double> fitnesses;
+    // targets, prob and alias of the edges out of type i are at [row_start[i], row_start[i+1])
+    vector<int> row_start;
+    vector<int> targets;
+    vector<double> prob;
+    vector<int> alias;
     bool is_mult;
+    
+    bool readFitnesses(string filename);
+    /* reads one row of the network per line, as comma-separated target type ids, each optionally followed by :weight
+     @return false if the file cannot be read or holds a bad target or weight
+     */
+    bool readNetwork(string filename);
 public:
     FixedSitesMutation();
-    ~FixedSitesMutation();
     void generateMutant(CellType& type, double b, double mut);
     bool read(std::vector<string>& params);
 };
 
+class HypercubeMutation: public MutationHandler {
+    /* genotypes are sets of num_loci biallelic loci, stored as bits of a 64-bit word, and a mutation flips one locus chosen uniformly.
+     fitness is computed on demand from the landscape parameters (NK, or additive with pairwise epistasis), using a hash of (seed, loci) in place of stored random tables,
+     so landscapes with up to 2^64 genotypes need no input files. computed fitnesses are kept in a bounded direct-mapped cache.
+     type ids are only given to genotypes that appear in a simulation. types from the input file have the all-zero genotype.
+     */
+private:
+    int num_loci;
+    bool is_nk;
+    // NK: each locus interacts with the next k loci (cyclically)
+    int k;
+    // additive: locus effects and pairwise epistatic effects are uniform on [-effect, effect] and [-epistasis, epistasis]
+    double effect;
+    double epistasis;
+    unsigned long long seed;
+    bool is_mult;
+    
+    // memoized fitnesses, indexed by a hash of the genotype. slots are overwritten on collision.
+    int cache_size;
+    vector<unsigned long long> cache_genotypes;
+    vector<double> cache_fitnesses;
+    vector<bool> cache_full;
+    
+    // genotype of every type id handed out in this simulation, and the type id of every genotype seen
+    vector<unsigned long long> type_genotypes;
+    vector<bool> has_genotype;
+    unordered_map<unsigned long long, int> genotype_types;
+    
+    static unsigned long long splitmix64(unsigned long long x);
+    // @return a uniform number in [0, 1) determined by the seed and the two keys
+    double hashUnit(unsigned long long key1, unsigned long long key2);
+    double computeFitness(unsigned long long genotype);
+    double getFitness(unsigned long long genotype);
+    unsigned long long getGenotype(int type_id);
+public:
+    HypercubeMutation();
+    void generateMutant(CellType& type, double b, double mut);
+    bool read(std::vector<string>& params);
+    // forgets the type ids of the last simulation. the fitness cache is kept, since the landscape does not change.
+    void refresh();
+};
+
 #endif /* MutationHandler_h */
@@ -0,0 +1,291 @@
+//
+//  OutputContainer.cpp
+//  evo_sim
+//
+//  A single packed file holding the output of every writer, in place of one file per writer, simulation and type.
+//
+
+#include "OutputContainer.h"
+#include <string.h>
+
+static void putBytes(string& dest, unsigned long long value, int num_bytes){
+    for (int i=0; i<num_bytes; i++){
+        dest.push_back(char(value & 0xff));
+        value >>= 8;
+    }
+}
+
+static void putString(string& dest, const string& value){
+    putBytes(dest, value.size(), 2);
+    dest += value;
+}
+
+static bool readBytes(FILE *file, unsigned long long& value, int num_bytes){
+    unsigned char bytes[8];
+    if (fread(bytes, 1, num_bytes, file) != size_t(num_bytes)){
+        return false;
+    }
+    value = 0;
+    for (int i=num_bytes-1; i>=0; i--){
+        value = (value << 8) | bytes[i];
+    }
+    return true;
+}
+
+static bool readString(FILE *file, string& value){
+    unsigned long long length;
+    if (!readBytes(file, length, 2)){
+        return false;
+    }
+    value.assign(length, ' ');
+    return length == 0 || fread(&value[0], 1, length, file) == length;
+}
+
+// the key fields shared by entry records and the index
+static void putKey(string& dest, const ContainerEntry& entry){
+    putString(dest, entry.name);
+    putString(dest, entry.key.writer);
+    putBytes(dest, (unsigned int)entry.key.sim_number, 4);
+    putBytes(dest, (unsigned int)entry.key.type, 4);
+}
+
+static bool readKey(FILE *file, ContainerEntry& entry){
+    unsigned long long sim_number, type;
+    if (!readString(file, entry.name) || !readString(file, entry.key.writer) || !readBytes(file, sim_number, 4) || !readBytes(file, type, 4)){
+        return false;
+    }
+    entry.key.sim_number = int((unsigned int)sim_number);
+    entry.key.type = int((unsigned int)type);
+    return true;
+}
+
+OutputKey::OutputKey(){
+    sim_number = 0;
+    type = -1;
+}
+
+OutputKey::OutputKey(const string& new_writer, int new_sim_number, int new_type){
+    writer = new_writer;
+    sim_number = new_sim_number;
+    type = new_type;
+}
+
+string OutputContainer::path;
+string OutputContainer::folder;
+FILE *OutputContainer::file = NULL;
+unsigned long long OutputContainer::file_size = 0;
+pthread_mutex_t OutputContainer::lock = PTHREAD_MUTEX_INITIALIZER;
+vector<ContainerEntry> OutputContainer::entries;
+map<string, int> OutputContainer::entry_ids;
+
+void OutputContainer::open(const string& new_folder, const string& name){
+    folder = new_folder;
+    path = folder + name;
+    file = fopen((path + ".pevo").c_str(), "wb");
+    if (!file){
+        throw "could not create output container";
+    }
+    string header = "PEVO";
+    putBytes(header, VERSION, 1);
+    fwrite(header.data(), 1, header.size(), file);
+    file_size = header.size();
+    entries.clear();
+    entry_ids.clear();
+}
+
+int OutputContainer::lookup(const string& filename, const OutputKey& key){
+    string name = filename;
+    if (name.compare(0, folder.size(), folder) == 0){
+        name = name.substr(folder.size());
+    }
+    pthread_mutex_lock(&lock);
+    int id;
+    map<string, int>::iterator found = entry_ids.find(name);
+    if (found != entry_ids.end()){
+        id = found->second;
+    }
+    else{
+        id = int(entries.size());
+        ContainerEntry entry;
+        entry.name = name;
+        entry.key = key;
+        if (entry.key.writer == ""){
+            entry.key.writer = name;
+        }
+        entry.recorded = false;
+        entries.push_back(entry);
+        entry_ids[name] = id;
+    }
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+void OutputContainer::append(int id, const char *data, size_t length){
+    if (length == 0){
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    ContainerEntry& entry = entries[id];
+    string header;
+    if (!entry.recorded){
+        putBytes(header, ENTRY_RECORD, 1);
+        putBytes(header, id, 4);
+        putKey(header, entry);
+        entry.recorded = true;
+    }
+    putBytes(header, DATA_RECORD, 1);
+    putBytes(header, id, 4);
+    putBytes(header, length, 4);
+    fwrite(header.data(), 1, header.size(), file);
+    fwrite(data, 1, length, file);
+    entry.offsets.push_back(file_size + header.size());
+    entry.lengths.push_back((unsigned int)length);
+    file_size += header.size() + length;
+    pthread_mutex_unlock(&lock);
+}
+
+void OutputContainer::close(){
+    if (!file){
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    fclose(file);
+    file = NULL;
+    string index = "PIDX";
+    putBytes(index, file_size, 8);
+    putBytes(index, entries.size(), 4);
+    for (size_t i=0; i<entries.size(); i++){
+        ContainerEntry& entry = entries[i];
+        putBytes(index, i, 4);
+        putKey(index, entry);
+        putBytes(index, entry.offsets.size(), 4);
+        for (size_t j=0; j<entry.offsets.size(); j++){
+            putBytes(index, entry.offsets[j], 8);
+            putBytes(index, entry.lengths[j], 4);
+        }
+    }
+    FILE *index_file = fopen((path + ".pidx").c_str(), "wb");
+    if (index_file){
+        fwrite(index.data(), 1, index.size(), index_file);
+        fclose(index_file);
+    }
+    entries.clear();
+    entry_ids.clear();
+    pthread_mutex_unlock(&lock);
+}
+
+ContainerReader::ContainerReader(){
+    file = NULL;
+}
+
+ContainerReader::~ContainerReader(){
+    if (file){
+        fclose(file);
+    }
+}
+
+bool ContainerReader::open(const string& path){
+    file = fopen(path.c_str(), "rb");
+    if (!file){
+        return false;
+    }
+    char magic[4];
+    unsigned long long version;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "PEVO", 4) != 0 || !readBytes(file, version, 1) || version != OutputContainer::VERSION){
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    unsigned long long data_size = ftell(file);
+    string index_path = path;
+    if (index_path.size() > 5 && index_path.compare(index_path.size() - 5, 5, ".pevo") == 0){
+        index_path = index_path.substr(0, index_path.size() - 5);
+    }
+    index_path += ".pidx";
+    // an index from an earlier run, or one missing data appended since, is not trusted
+    if (!readIndex(index_path, data_size)){
+        entries.clear();
+        return scan();
+    }
+    return true;
+}
+
+bool ContainerReader::readIndex(const string& index_path, unsigned long long data_size){
+    FILE *index_file = fopen(index_path.c_str(), "rb");
+    if (!index_file){
+        return false;
+    }
+    char magic[4];
+    unsigned long long size, num_entries;
+    bool good = fread(magic, 1, 4, index_file) == 4 && memcmp(magic, "PIDX", 4) == 0;
+    good = good && readBytes(index_file, size, 8) && size == data_size && readBytes(index_file, num_entries, 4);
+    for (unsigned long long i=0; good && i<num_entries; i++){
+        ContainerEntry entry;
+        unsigned long long id, num_pieces;
+        good = readBytes(index_file, id, 4) && readKey(index_file, entry) && readBytes(index_file, num_pieces, 4);
+        for (unsigned long long j=0; good && j<num_pieces; j++){
+            unsigned long long offset, length;
+            good = readBytes(index_file, offset, 8) && readBytes(index_file, length, 4);
+            entry.offsets.push_back(offset);
+            entry.lengths.push_back((unsigned int)length);
+        }
+        entry.recorded = true;
+        entries.push_back(entry);
+    }
+    fclose(index_file);
+    return good;
+}
+
+bool ContainerReader::scan(){
+    fseek(file, 5, SEEK_SET);
+    unsigned long long kind, id, length;
+    while (readBytes(file, kind, 1) && readBytes(file, id, 4)){
+        if (kind == OutputContainer::ENTRY_RECORD){
+            if (id >= entries.size()){
+                entries.resize(id + 1);
+            }
+            if (!readKey(file, entries[id])){
+                break;
+            }
+            entries[id].recorded = true;
+        }
+        else if (kind == OutputContainer::DATA_RECORD && id < entries.size()){
+            if (!readBytes(file, length, 4)){
+                break;
+            }
+            entries[id].offsets.push_back(ftell(file));
+            entries[id].lengths.push_back((unsigned int)length);
+            if (fseek(file, length, SEEK_CUR) != 0){
+                break;
+            }
+        }
+        else{
+            return false;
+        }
+    }
+    // ids of entries whose record never made it to disk
+    vector<ContainerEntry> recorded;
+    for (size_t i=0; i<entries.size(); i++){
+        if (entries[i].recorded){
+            recorded.push_back(entries[i]);
+        }
+    }
+    entries.swap(recorded);
+    return true;
+}
+
+bool ContainerReader::extract(int i, FILE *out){
+    ContainerEntry& entry = entries[i];
+    vector<char> buffer;
+    for (size_t j=0; j<entry.offsets.size(); j++){
+        buffer.resize(entry.lengths[j]);
+        if (fseek(file, entry.offsets[j], SEEK_SET) != 0){
+            return false;
+        }
+        size_t length = fread(buffer.data(), 1, buffer.size(), file);
+        fwrite(buffer.data(), 1, length, out);
+        if (length != buffer.size()){
+            return false;
+        }
+    }
+    return true;
+}
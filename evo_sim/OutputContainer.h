@@ -0,0 +1,106 @@
+//
+//  OutputContainer.hpp
+//  evo_sim
+//
+//  A single packed file holding the output of every writer, in place of one file per writer, simulation and type.
+//
+
+#ifndef OutputContainer_h
+#define OutputContainer_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+
+using namespace std;
+
+/* the container is two files. the data file, [name].pevo, starts with "PEVO" and a u8 version, followed by records appended as output arrives:
+     u8 ENTRY_RECORD, u32 entry id, u16 name length, name, u16 writer length, writer, i32 sim number, i32 type
+     u8 DATA_RECORD, u32 entry id, u32 length, data
+ the data of an entry is the concatenation of its DATA records, and is exactly what the file of that name would have held.
+ the index, [name].pidx, is written when the container is closed and lists each entry with the position of its data in the data file:
+     "PIDX", u64 length of the data file it describes, u32 number of entries, then for each entry:
+     u32 id, u16 name length, name, u16 writer length, writer, i32 sim number, i32 type, u32 number of pieces, then u64 offset and u32 length of each piece.
+ a data file without an index (for example after a crash) can still be read by scanning its records.
+ all numbers are little endian.
+ */
+struct OutputKey{
+    // what an entry holds, for listing and extracting
+    string writer;
+    // the one simulation whose output this is, or 0 or less for output shared by several simulations
+    int sim_number;
+    // cell type index, or -1 if the entry is not for one type
+    int type;
+    OutputKey();
+    OutputKey(const string& new_writer, int new_sim_number, int new_type);
+};
+
+struct ContainerEntry{
+    string name;
+    OutputKey key;
+    // offset in the data file and length of each piece of data, in order
+    vector<unsigned long long> offsets;
+    vector<unsigned int> lengths;
+    // whether the entry record is in the data file yet
+    bool recorded;
+};
+
+class OutputContainer{
+    /* while open, every OutputFile becomes an entry of the container rather than a file of its own.
+     entries are append only: opening an existing entry again continues it.
+     */
+public:
+    static const int VERSION = 1;
+    static const int ENTRY_RECORD = 1;
+    static const int DATA_RECORD = 2;
+private:
+    static string path;
+    // output folder; entry names are file paths relative to it
+    static string folder;
+    static FILE *file;
+    static unsigned long long file_size;
+    static pthread_mutex_t lock;
+    static vector<ContainerEntry> entries;
+    static map<string, int> entry_ids;
+public:
+    /* creates the container, replacing any earlier one of that name.
+     @param new_folder output folder, prepended to the data and index file names
+     @param name file name of the container without extension
+     */
+    static void open(const string& new_folder, const string& name);
+    static bool isOpen(){
+        return file != NULL;
+    }
+    static const string& getPath(){
+        return path;
+    }
+    // @return id of the entry for a file, creating the entry on first use. cheap: nothing is written until data arrives.
+    static int lookup(const string& filename, const OutputKey& key);
+    static void append(int id, const char *data, size_t length);
+    // writes the index and closes the data file. must be called after every output file has been closed or flushed for the last time.
+    static void close();
+};
+
+class ContainerReader{
+    /* lists and extracts the entries of a container, using its index when there is an up to date one.
+     */
+private:
+    FILE *file;
+    vector<ContainerEntry> entries;
+    bool readIndex(const string& index_path, unsigned long long data_size);
+    bool scan();
+public:
+    ContainerReader();
+    ~ContainerReader();
+    // @param path the data file (.pevo)
+    bool open(const string& path);
+    const vector<ContainerEntry>& getEntries(){
+        return entries;
+    }
+    // writes the data of entry i to out. @return false on a read error
+    bool extract(int i, FILE *out);
+};
+
+#endif /* OutputContainer_h */
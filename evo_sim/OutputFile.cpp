@@ -0,0 +1,321 @@
+//
+//  OutputFile.cpp
+//  evo_sim
+//
+//  Output streams for writers, optionally drained to disk by dedicated I/O threads.
+//
+
+#include "OutputFile.h"
+#include <functional>
+#include <sched.h>
+#include <time.h>
+
+OutputRing::OutputRing(){
+    head.store(0);
+    tail.store(0);
+}
+
+bool OutputRing::push(OutputBlock *block){
+    size_t curr_tail = tail.load(std::memory_order_relaxed);
+    if (curr_tail - head.load(std::memory_order_acquire) == CAPACITY){
+        return false;
+    }
+    slots[curr_tail % CAPACITY] = block;
+    tail.store(curr_tail + 1, std::memory_order_release);
+    return true;
+}
+
+OutputBlock* OutputRing::pop(){
+    size_t curr_head = head.load(std::memory_order_relaxed);
+    if (curr_head == tail.load(std::memory_order_acquire)){
+        return NULL;
+    }
+    OutputBlock *block = slots[curr_head % CAPACITY];
+    head.store(curr_head + 1, std::memory_order_release);
+    return block;
+}
+
+int OutputPipeline::num_io_threads = 0;
+vector<pthread_t> OutputPipeline::io_threads;
+pthread_mutex_t OutputPipeline::lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t OutputPipeline::wake = PTHREAD_COND_INITIALIZER;
+vector<vector<OutputRing *> > OutputPipeline::rings;
+std::atomic<bool> OutputPipeline::stopping(false);
+__thread vector<OutputRing *> *OutputPipeline::thread_rings = NULL;
+vector<vector<OutputRing *> *> OutputPipeline::all_thread_rings;
+
+void OutputPipeline::start(int num){
+    if (num <= 0){
+        return;
+    }
+    num_io_threads = num;
+    stopping.store(false);
+    rings.resize(num);
+    io_threads.resize(num);
+    for (long i=0; i<num; i++){
+        if (pthread_create(&io_threads[i], NULL, ioMain, (void *)i)){
+            throw "could not start output thread";
+        }
+    }
+}
+
+void OutputPipeline::submit(OutputBlock *block){
+    if (!thread_rings){
+        thread_rings = new vector<OutputRing *>();
+        pthread_mutex_lock(&lock);
+        for (int i=0; i<num_io_threads; i++){
+            OutputRing *ring = new OutputRing();
+            rings[i].push_back(ring);
+            thread_rings->push_back(ring);
+        }
+        all_thread_rings.push_back(thread_rings);
+        pthread_mutex_unlock(&lock);
+    }
+    OutputRing *ring = (*thread_rings)[std::hash<string>()(block->path) % num_io_threads];
+    while (!ring->push(block)){
+        // the I/O thread is behind the disk: wait for room rather than grow without bound
+        pthread_cond_signal(&wake);
+        sched_yield();
+    }
+    pthread_cond_signal(&wake);
+}
+
+void *OutputPipeline::ioMain(void *arg){
+    int id = int((long)arg);
+    map<string, FILE *> files;
+    vector<OutputRing *> my_rings;
+    while (true){
+        // anything submitted before stop() was called is in the rings by now
+        bool was_stopping = stopping.load();
+        pthread_mutex_lock(&lock);
+        my_rings = rings[id];
+        pthread_mutex_unlock(&lock);
+        bool handled = false;
+        for (size_t i=0; i<my_rings.size(); i++){
+            OutputBlock *block;
+            while ((block = my_rings[i]->pop())){
+                handleBlock(block, files);
+                delete block;
+                handled = true;
+            }
+        }
+        if (handled){
+            continue;
+        }
+        if (was_stopping){
+            break;
+        }
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 1000000;
+        if (deadline.tv_nsec >= 1000000000){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&lock);
+        pthread_cond_timedwait(&wake, &lock, &deadline);
+        pthread_mutex_unlock(&lock);
+    }
+    for (map<string, FILE *>::iterator it = files.begin(); it != files.end(); ++it){
+        if (it->second){
+            fclose(it->second);
+        }
+    }
+    return NULL;
+}
+
+void OutputPipeline::handleBlock(OutputBlock *block, map<string, FILE *>& files){
+    if (block->entry >= 0){
+        OutputContainer::append(block->entry, block->data.data(), block->data.size());
+        return;
+    }
+    map<string, FILE *>::iterator found = files.find(block->path);
+    if (block->kind == OutputBlock::CLOSE){
+        if (found != files.end()){
+            if (found->second){
+                fclose(found->second);
+            }
+            files.erase(found);
+        }
+        return;
+    }
+    if (block->kind == OutputBlock::OPEN && found != files.end() && block->truncate){
+        if (found->second){
+            fclose(found->second);
+        }
+        files.erase(found);
+        found = files.end();
+    }
+    if (found == files.end()){
+        bool truncate = block->kind == OutputBlock::OPEN && block->truncate;
+        FILE *file = fopen(block->path.c_str(), truncate ? "w" : "a");
+        if (file){
+            setvbuf(file, NULL, _IOFBF, OutputBuffer::BLOCK_SIZE);
+        }
+        found = files.insert(make_pair(block->path, file)).first;
+    }
+    if (block->kind == OutputBlock::DATA && found->second){
+        fwrite(block->data.data(), 1, block->data.size(), found->second);
+    }
+}
+
+void OutputPipeline::stop(){
+    if (num_io_threads == 0){
+        return;
+    }
+    stopping.store(true);
+    pthread_cond_broadcast(&wake);
+    for (int i=0; i<num_io_threads; i++){
+        pthread_join(io_threads[i], NULL);
+    }
+    for (size_t i=0; i<rings.size(); i++){
+        for (size_t j=0; j<rings[i].size(); j++){
+            delete rings[i][j];
+        }
+    }
+    rings.clear();
+    for (size_t i=0; i<all_thread_rings.size(); i++){
+        delete all_thread_rings[i];
+    }
+    all_thread_rings.clear();
+    thread_rings = NULL;
+    io_threads.clear();
+    num_io_threads = 0;
+}
+
+OutputBuffer::OutputBuffer(){
+    is_open = false;
+    entry = -1;
+    shared = false;
+    file = NULL;
+    setp(area, area + AREA_SIZE);
+}
+
+OutputBuffer::~OutputBuffer(){
+    close();
+}
+
+void OutputBuffer::collect(){
+    pending.append(pbase(), pptr() - pbase());
+    setp(area, area + AREA_SIZE);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c){
+    collect();
+    if (c != traits_type::eof()){
+        pending.push_back(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+}
+
+int OutputBuffer::sync(){
+    collect();
+    // every endl syncs. writing directly, the line reaches the file then, as with ofstream; with I/O threads or a container it waits for a full block,
+    // or for the end of the record in a shared file, since blocks from several simulation threads are written in no set order
+    if (!OutputPipeline::isAsync() && entry < 0){
+        send();
+    }
+    else if (pending.size() >= BLOCK_SIZE && !shared){
+        send();
+    }
+    return 0;
+}
+
+void OutputBuffer::send(){
+    if (!is_open || pending.empty()){
+        pending.clear();
+        return;
+    }
+    if (OutputPipeline::isAsync()){
+        OutputBlock *block = new OutputBlock();
+        block->kind = OutputBlock::DATA;
+        block->path = entry < 0 ? path : OutputContainer::getPath();
+        block->truncate = false;
+        block->entry = entry;
+        block->data.swap(pending);
+        OutputPipeline::submit(block);
+    }
+    else if (entry >= 0){
+        OutputContainer::append(entry, pending.data(), pending.size());
+    }
+    else{
+        fwrite(pending.data(), 1, pending.size(), file);
+        fflush(file);
+    }
+    pending.clear();
+}
+
+void OutputBuffer::endRecord(){
+    collect();
+    send();
+}
+
+void OutputBuffer::open(const string& filename, bool truncate, const OutputKey& key){
+    close();
+    path = filename;
+    shared = key.sim_number <= 0;
+    if (OutputContainer::isOpen()){
+        entry = OutputContainer::lookup(path, key);
+        is_open = true;
+    }
+    else if (OutputPipeline::isAsync()){
+        OutputBlock *block = new OutputBlock();
+        block->kind = OutputBlock::OPEN;
+        block->path = path;
+        block->truncate = truncate;
+        block->entry = -1;
+        OutputPipeline::submit(block);
+        is_open = true;
+    }
+    else{
+        file = fopen(path.c_str(), truncate ? "w" : "a");
+        is_open = file != NULL;
+    }
+}
+
+void OutputBuffer::close(){
+    if (!is_open){
+        collect();
+        pending.clear();
+        return;
+    }
+    endRecord();
+    if (entry >= 0){
+        entry = -1;
+    }
+    else if (OutputPipeline::isAsync()){
+        OutputBlock *block = new OutputBlock();
+        block->kind = OutputBlock::CLOSE;
+        block->path = path;
+        block->truncate = false;
+        block->entry = -1;
+        OutputPipeline::submit(block);
+    }
+    else if (file){
+        fclose(file);
+        file = NULL;
+    }
+    is_open = false;
+}
+
+OutputFile::OutputFile() : ostream(NULL){
+    rdbuf(&buffer);
+}
+
+OutputFile::~OutputFile(){
+    buffer.close();
+}
+
+void OutputFile::open(const string& filename, ios_base::openmode mode, const OutputKey& key){
+    clear();
+    buffer.open(filename, !(mode & ios_base::app), key);
+}
+
+OutputFile& OutputFile::flush(){
+    buffer.endRecord();
+    return *this;
+}
+
+void OutputFile::close(){
+    buffer.close();
+}
@@ -0,0 +1,147 @@
+//
+//  OutputFile.hpp
+//  evo_sim
+//
+//  Output streams for writers, optionally drained to disk by dedicated I/O threads.
+//
+
+#ifndef OutputFile_h
+#define OutputFile_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <pthread.h>
+#include "OutputContainer.h"
+
+using namespace std;
+
+struct OutputBlock{
+    // one request from a simulation thread to an I/O thread. blocks for one file are handled in the order they were submitted.
+    enum Kind {OPEN, DATA, CLOSE};
+    Kind kind;
+    string path;
+    // for OPEN: whether the file is emptied rather than appended to
+    bool truncate;
+    // for DATA: the container entry the data belongs to, or -1 for a file of its own
+    int entry;
+    string data;
+};
+
+class OutputRing{
+    /* fixed-capacity queue of blocks from one simulation thread to one I/O thread.
+     lock free for exactly one producer and one consumer.
+     */
+public:
+    static const size_t CAPACITY = 1024;
+private:
+    OutputBlock *slots[CAPACITY];
+    // next slot to read, written only by the consumer
+    std::atomic<size_t> head;
+    // next slot to fill, written only by the producer
+    std::atomic<size_t> tail;
+public:
+    OutputRing();
+    // @return false if the ring is full
+    bool push(OutputBlock *block);
+    // @return the oldest block, or NULL if the ring is empty
+    OutputBlock* pop();
+};
+
+class OutputPipeline{
+    /* I/O threads that write the blocks submitted by simulation threads. each file is always handled by the same I/O thread, and every simulation thread has its own ring to each I/O thread,
+     so simulation threads never wait for the disk or for each other (only for a full ring).
+     with no I/O threads started, output files write directly, as ofstream would.
+     data for an OutputContainer is submitted under the container's path, so one I/O thread does all the container's writing.
+     */
+private:
+    static int num_io_threads;
+    static vector<pthread_t> io_threads;
+    // guards rings and the I/O threads' sleep
+    static pthread_mutex_t lock;
+    static pthread_cond_t wake;
+    // rings[i] holds every simulation thread's ring to I/O thread i
+    static vector<vector<OutputRing *> > rings;
+    static std::atomic<bool> stopping;
+    // this simulation thread's ring to each I/O thread, NULL until it first submits
+    static __thread vector<OutputRing *> *thread_rings;
+    // every thread's thread_rings, freed by stop()
+    static vector<vector<OutputRing *> *> all_thread_rings;
+
+    static void *ioMain(void *arg);
+    static void handleBlock(OutputBlock *block, map<string, FILE *>& files);
+public:
+    // starts num I/O threads. must be called before any simulation thread starts.
+    static void start(int num);
+    static bool isAsync(){
+        return num_io_threads > 0;
+    }
+    // hands a block to the I/O thread for its file. the pipeline takes ownership of block.
+    static void submit(OutputBlock *block);
+    // writes everything submitted so far, closes every file and joins the I/O threads. must be called after every simulation thread has finished.
+    static void stop();
+};
+
+class OutputBuffer: public streambuf{
+    /* collects text written to an OutputFile. text reaches the file at every flush of the stream when writing directly,
+     and in blocks of at least BLOCK_SIZE (or at OutputFile::flush) when using I/O threads or a container.
+     a file shared by several simulations is only sent at OutputFile::flush, so no other simulation's record can come between the blocks of one record.
+     */
+public:
+    static const size_t BLOCK_SIZE = 1 << 16;
+private:
+    static const int AREA_SIZE = 1024;
+    char area[AREA_SIZE];
+    string pending;
+    string path;
+    bool is_open;
+    // id in the OutputContainer, or -1 when writing a file of its own
+    int entry;
+    // whether several simulations write records to the file
+    bool shared;
+    // used only when writing directly
+    FILE *file;
+
+    void collect();
+    // writes or submits everything collected so far
+    void send();
+protected:
+    int_type overflow(int_type c);
+    int sync();
+public:
+    OutputBuffer();
+    ~OutputBuffer();
+    void open(const string& filename, bool truncate, const OutputKey& key);
+    bool isOpen(){
+        return is_open;
+    }
+    // ends a record: everything written so far goes to the file together
+    void endRecord();
+    void close();
+};
+
+class OutputFile: public ostream{
+    /* drop-in replacement for the ofstream members of writers. a flush() ends a record, so records written by several simulations to one file are never interleaved.
+     while an OutputContainer is open, the file becomes an entry of the container.
+     */
+private:
+    OutputBuffer buffer;
+public:
+    OutputFile();
+    ~OutputFile();
+    /* @param mode ios::app to append, anything else empties the file (container entries are always appended to)
+     @param key describes the file's contents in a container
+     */
+    void open(const string& filename, ios_base::openmode mode = ios_base::out, const OutputKey& key = OutputKey());
+    bool is_open(){
+        return buffer.isOpen();
+    }
+    OutputFile& flush();
+    void close();
+};
+
+#endif /* OutputFile_h */
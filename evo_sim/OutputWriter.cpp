@@ -15,6 +15,7 @@
 #include <string>
 #include <fstream>
 #include <cmath>
+#include <sstream>
 
 using namespace std;
 
@@ -30,15 +31,27 @@ DuringOutputWriter::DuringOutputWriter(string ofile, int period){
     ofile_loc = ofile;
     last_written = 0;
     writing_period = period;
+    binary = false;
 }
 
 DuringOutputWriter::DuringOutputWriter(string ofile){
     ofile_loc = ofile;
     last_written = 0;
     writing_period = 0;
+    binary = false;
+}
+
+string DuringOutputWriter::outputName(const string& name){
+    if (!binary || name.size() < 5 || name.compare(name.size() - 5, 5, ".oevo") != 0){
+        return name;
+    }
+    return name.substr(0, name.size() - 5) + ".bevo";
 }
 
 bool DuringOutputWriter::shouldWrite(CList& clone_list){
+    if (grid.isActive()){
+        return false;
+    }
     if (writing_period == 0){
         return true;
     }
@@ -50,13 +63,33 @@ bool DuringOutputWriter::shouldWrite(CList& clone_list){
     return false;
 }
 
+void DuringOutputWriter::beforeAdvance(CList& clone_list){
+    if (!grid.isActive() || !grid.hasNext()){
+        return;
+    }
+    // the current state holds until the next event
+    double next_time = clone_list.nextEventTime();
+    while (grid.hasNext() && grid.nextTime() < next_time){
+        writeState(clone_list, grid.nextTime());
+        grid.advance();
+    }
+}
+
+void DuringOutputWriter::finishGrid(CList& clone_list){
+    bool extinct = clone_list.isExtinct();
+    while (grid.hasNext() && (extinct || grid.nextTime() <= clone_list.getCurrTime())){
+        writeState(clone_list, grid.nextTime());
+        grid.advance();
+    }
+}
+
 TypeStructureWriter::TypeStructureWriter(string ofile):FinalOutputWriter(ofile){
     ofile_name = "type_tree.oevo";
 }
 
 void TypeStructureWriter::beginAction(CList &clone_list){
     string ofile_middle = "sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app, OutputKey("TypeStructure", sim_number, -1));
 }
 
 TypeStructureWriter::~TypeStructureWriter(){
@@ -78,10 +111,14 @@ CellCountWriter::CellCountWriter(string ofile, int period, int i, int sim):Durin
     ofile_name = "type_" + to_string(i) + ".oevo";
     index = i;
     sim_number = sim;
+    changes_only = false;
+    last_count = 0;
 }
 
 CellCountWriter::CellCountWriter(string ofile): DuringOutputWriter(ofile){
     index = 0;
+    changes_only = false;
+    last_count = 0;
 }
 
 NumMutationsWriter::NumMutationsWriter(string ofile): DuringOutputWriter(ofile){
@@ -123,7 +160,10 @@ bool NumMutationsWriter::readLine(vector<string>& parsed_line){
 }
 
 bool CellCountWriter::readLine(vector<string>& parsed_line){
-    if (parsed_line.size() != 2){
+    if (parsed_line.size() != 2 && parsed_line.size() != 3){
+        return false;
+    }
+    if (parsed_line.size() == 3 && parsed_line[2] != "changes"){
         return false;
     }
     try{
@@ -133,40 +173,92 @@ bool CellCountWriter::readLine(vector<string>& parsed_line){
     catch (...){
         return false;
     }
+    changes_only = parsed_line.size() == 3;
     ofile_name = "type_" + to_string(index) + ".oevo";
     return true;
 }
 
 void CellCountWriter::beginAction(CList& clone_list){
     string ofile_middle = "count_sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
-    outfile << "data for cell type " << index << " sim number " << sim_number << endl;
-    if (clone_list.hasCellType(index)){
-        outfile << clone_list.getCurrTime() << ", " << clone_list.getTypeByIndex(index)->getNumCells() << endl;
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("CellCount", sim_number, index));
+    last_count = 0;
+    if (binary){
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number), changes_only ? TrajectoryEncoder::CHANGES : 0);
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        trajectory.addColumn("count", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    }
+    else{
+        outfile << "data for cell type " << index << " sim number " << sim_number << endl;
+    }
+    if (grid.isActive()){
+        // a type added during the simulation had no cells at the grid times already passed
+        while (grid.hasNext() && grid.nextTime() < clone_list.getCurrTime()){
+            write_count(grid.nextTime(), 0);
+            grid.advance();
+        }
+    }
+    else if (clone_list.hasCellType(index)){
+        write_count(clone_list.getCurrTime(), clone_list.getTypeByIndex(index)->getNumCells());
     }
 }
 
+void CellCountWriter::writeState(CList& clone_list, double time){
+    write_count(time, clone_list.hasCellType(index) ? clone_list.getTypeByIndex(index)->getNumCells() : 0);
+}
+
+void CellCountWriter::write_count(double time, long long num_cells){
+    last_count = num_cells;
+    if (binary){
+        trajectory.add(time).add(num_cells).endRow();
+        return;
+    }
+    outfile << time << ", " << num_cells << endl;
+}
+
 void NumMutationsWriter::beginAction(CList& clone_list){
     string ofile_middle = "muts_sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("NumMutations", sim_number, index));
+    if (binary){
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number));
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        return;
+    }
     outfile << "data for cell type " << index << " sim number " << sim_number << endl;
 }
 
 void MotherDaughterWriter::beginAction(CList& clone_list){
     string ofile_middle = "mother_daughter_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("MotherDaughter", sim_number, index));
+    if (binary){
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number));
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        trajectory.addColumn("mother_birth", TrajectoryColumn::REAL);
+        trajectory.addColumn("daughter_birth", TrajectoryColumn::REAL);
+        return;
+    }
     outfile << "data for cell type " << index << " sim number " << sim_number << endl;
 }
 
 void MotherDaughterWriter::duringSimAction(CList &clone_list){
     if (shouldWrite(clone_list) && clone_list.hasCellType(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
+        if (binary){
+            trajectory.add(clone_list.getCurrTime()).add(clone_list.getMotherBirth()).add(clone_list.getDaughterBirth()).endRow();
+            return;
+        }
         outfile << clone_list.getCurrTime() << ", " << clone_list.getMotherBirth() << ", " << clone_list.getDaughterBirth() << endl;
     }
 }
 
 void CountStepWriter::beginAction(CList& clone_list){
     string ofile_middle = "count_step_sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("CountStep", sim_number, index));
+    if (binary){
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number));
+        trajectory.addColumn("step", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+        trajectory.addColumn("count", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+        trajectory.add(timestep).add(clone_list.getTypeByIndex(index)->getNumCells()).endRow();
+        return;
+    }
     outfile << "data for cell type " << index << " sim number " << sim_number << endl;
     outfile << timestep << ", " << clone_list.getTypeByIndex(index)->getNumCells() << endl;
 }
@@ -189,58 +281,80 @@ CellCountWriter::~CellCountWriter(){
 void CountStepWriter::duringSimAction(CList& clone_list){
     timestep ++;
     if (shouldWrite(clone_list) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
+        if (binary){
+            trajectory.add(timestep).add(clone_list.getTypeByIndex(index)->getNumCells()).endRow();
+            return;
+        }
         outfile << timestep << ", " << clone_list.getTypeByIndex(index)->getNumCells() << endl;
     }
 }
 
 void CellCountWriter::duringSimAction(CList& clone_list){
+    if (changes_only){
+        // extinction is a change too, so unlike every-event output it is recorded
+        long long num_cells = clone_list.hasCellType(index) ? clone_list.getTypeByIndex(index)->getNumCells() : 0;
+        if (num_cells != last_count && shouldWrite(clone_list)){
+            write_count(clone_list.getCurrTime(), num_cells);
+        }
+        return;
+    }
     if (shouldWrite(clone_list) && clone_list.hasCellType(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
-        outfile << clone_list.getCurrTime() << ", " << clone_list.getTypeByIndex(index)->getNumCells() << endl;
+        write_count(clone_list.getCurrTime(), clone_list.getTypeByIndex(index)->getNumCells());
     }
 }
 
 void NumMutationsWriter::duringSimAction(CList& clone_list){
     MutationHandler* temp_mut = &(clone_list.getMutHandler());
     if (shouldWrite(clone_list) && temp_mut->has_mut() && temp_mut->getNewType().getIndex() == index){
+        if (binary){
+            trajectory.add(clone_list.getCurrTime()).endRow();
+            return;
+        }
         outfile << clone_list.getCurrTime() << endl;
     }
 }
 
 void CellCountWriter::finalAction(CList& clone_list){
-    if (clone_list.hasCellType(index)){
-        outfile << clone_list.getCurrTime() << ", " << clone_list.getTypeByIndex(index)->getNumCells() << endl;
+    if (grid.isActive()){
+        finishGrid(clone_list);
     }
     else{
-        outfile << clone_list.getCurrTime() << ", " << 0 << endl;
+        writeState(clone_list, clone_list.getCurrTime());
     }
+    trajectory.finish();
     outfile.flush();
     outfile.close();
     resetWriter();
 }
 
 void CountStepWriter::finalAction(CList& clone_list){
+    trajectory.finish();
     outfile.flush();
     outfile.close();
     sim_number++;
 }
 
 void NumMutationsWriter::finalAction(CList& clone_list){
+    trajectory.finish();
     outfile.flush();
     outfile.close();
     sim_number++;
 }
 
 void MotherDaughterWriter::finalAction(CList& clone_list){
+    trajectory.finish();
     outfile.flush();
     outfile.close();
 }
 
 AllTypesWriter::AllTypesWriter(string ofile, int period): DuringOutputWriter(ofile, period){
     ofile_name = "all_types";
+    changes_only = false;
 }
 
 AllTypesWriter::AllTypesWriter(string ofile): DuringOutputWriter(ofile){
     ofile_name = "all_types";
+    changes_only = false;
 }
 
 TunnelWriter::TunnelWriter(string ofile): DuringOutputWriter(ofile){
@@ -290,6 +404,9 @@ void AllTypesWriter::beginAction(CList& clone_list){
     for (vector<CellType *>::iterator it = root_types.begin(); it != root_types.end(); ++it){
         type_index = (*it)->getIndex();
         CellCountWriter *new_writer = new CellCountWriter(ofile_loc, writing_period, type_index, sim_number);
+        new_writer->setBinary(binary);
+        new_writer->setChangesOnly(changes_only);
+        new_writer->setGrid(grid);
         writers.push_back(new_writer);
         new_writer->beginAction(clone_list);
     }
@@ -319,11 +436,20 @@ void AllTypesWriter::duringSimAction(CList& clone_list){
     }
     for (vector<int>::iterator it = new_types.begin(); it != new_types.end(); ++it){
         CellCountWriter *new_writer = new CellCountWriter(ofile_loc, writing_period, (*it), sim_number);
+        new_writer->setBinary(binary);
+        new_writer->setChangesOnly(changes_only);
+        new_writer->setGrid(grid);
         writers.push_back(new_writer);
         new_writer->beginAction(clone_list);
     }
 }
 
+void AllTypesWriter::beforeAdvance(CList& clone_list){
+    for (vector<CellCountWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
+        (*it)->beforeAdvance(clone_list);
+    }
+}
+
 void AllTypesWriter::finalAction(CList& clone_list){
     for (vector<CellCountWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
         (*it)->finalAction(clone_list);
@@ -333,7 +459,10 @@ void AllTypesWriter::finalAction(CList& clone_list){
 }
 
 bool AllTypesWriter::readLine(vector<string>& parsed_line){
-    if (parsed_line.size() != 1){
+    if (parsed_line.size() != 1 && parsed_line.size() != 2){
+        return false;
+    }
+    if (parsed_line.size() == 2 && parsed_line[1] != "changes"){
         return false;
     }
     try{
@@ -342,6 +471,7 @@ bool AllTypesWriter::readLine(vector<string>& parsed_line){
     catch (...){
         return false;
     }
+    changes_only = parsed_line.size() == 2;
     return true;
 }
 
@@ -535,14 +665,28 @@ bool MeanFitWriter::readLine(vector<string>& parsed_line){
 
 void FitnessDistWriter::beginAction(CList& clone_list){
     string ofile_middle = "fit_sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("FitnessDist", sim_number, index));
+    if (binary){
+        // one row per clone rather than per cell: the text line repeats each birth rate cells times
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number), TrajectoryEncoder::GROUPED | TrajectoryEncoder::REPEATED);
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        trajectory.addColumn("birth_rate", TrajectoryColumn::REAL);
+        trajectory.addColumn("cells", TrajectoryColumn::INTEGER);
+        return;
+    }
     outfile << "data for cell type " << index << " sim number " << sim_number << endl;
     
 }
 
 void MeanFitWriter::beginAction(CList& clone_list){
     string ofile_middle = "mean_fit_sim_"+to_string(sim_number);
-    outfile.open(ofile_loc + ofile_middle + ofile_name, ios::app);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("MeanFit", sim_number, index));
+    if (binary){
+        trajectory.begin(outfile, "data for cell type " + to_string(index) + " sim number " + to_string(sim_number));
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        trajectory.addColumn("mean_fit", TrajectoryColumn::REAL);
+        return;
+    }
     outfile << "data for cell type " << index << " sim number " << sim_number << endl;
 }
 
@@ -561,40 +705,487 @@ TunnelWriter::~TunnelWriter(){
     outfile.close();
 }
 
-void FitnessDistWriter::write_dist(ofstream& outfile, CList& clone_list){
+void FitnessDistWriter::write_dist(ostream& outfile, CList& clone_list){
     Clone *curr_clone = (clone_list.getTypeByIndex(index)->getRoot());
     while (curr_clone){
-        int num_cells = curr_clone->getCellCount();
-        for (int i=0; i<num_cells; i++){
+        long long num_cells = curr_clone->getCellCount();
+        for (long long i=0; i<num_cells; i++){
             outfile << ", " << curr_clone->getBirthRate();
         }
         curr_clone = &(curr_clone->getNextWithinType());
     }
 }
 
-void FitnessDistWriter::duringSimAction(CList& clone_list){
-    if (shouldWrite(clone_list) && clone_list.getTypeByIndex(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
-        outfile << clone_list.getCurrTime();
+void FitnessDistWriter::write_dist(TrajectoryEncoder& trajectory, CList& clone_list, double curr_time){
+    Clone *curr_clone = (clone_list.getTypeByIndex(index)->getRoot());
+    while (curr_clone){
+        if (curr_clone->getCellCount() > 0){
+            trajectory.add(curr_time).add(curr_clone->getBirthRate()).add(curr_clone->getCellCount()).endRow();
+        }
+        curr_clone = &(curr_clone->getNextWithinType());
+    }
+}
+
+void FitnessDistWriter::writeState(CList& clone_list, double time){
+    if (clone_list.getTypeByIndex(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
+        if (binary){
+            write_dist(trajectory, clone_list, time);
+            return;
+        }
+        outfile << time;
         write_dist(outfile, clone_list);
         outfile << endl;
     }
 }
 
+void FitnessDistWriter::duringSimAction(CList& clone_list){
+    if (shouldWrite(clone_list)){
+        writeState(clone_list, clone_list.getCurrTime());
+    }
+}
+
+void MeanFitWriter::writeState(CList& clone_list, double time){
+    if (clone_list.getTypeByIndex(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
+        double mean_fit = (clone_list.getTypeByIndex(index)->getBirthRate())/clone_list.getTypeByIndex(index)->getNumCells();
+        if (binary){
+            trajectory.add(time).add(mean_fit).endRow();
+            return;
+        }
+        outfile << time << ", ";
+        outfile << mean_fit << endl;
+    }
+}
+
 void MeanFitWriter::duringSimAction(CList& clone_list){
-    if (shouldWrite(clone_list) && clone_list.getTypeByIndex(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
-        outfile << clone_list.getCurrTime() << ", ";
-        outfile << (clone_list.getTypeByIndex(index)->getBirthRate())/clone_list.getTypeByIndex(index)->getNumCells() << endl;
+    if (shouldWrite(clone_list)){
+        writeState(clone_list, clone_list.getCurrTime());
     }
 }
 
 void MeanFitWriter::finalAction(CList& clone_list){
-    outfile << clone_list.getCurrTime() << ", ";
+    if (grid.isActive()){
+        finishGrid(clone_list);
+    }
+    if (binary){
+        trajectory.finish();
+    }
+    else if (!grid.isActive()){
+        outfile << clone_list.getCurrTime() << ", ";
+    }
     outfile.flush();
     outfile.close();
     resetWriter();
 }
 
 void FitnessDistWriter::finalAction(CList& clone_list){
+    if (grid.isActive()){
+        finishGrid(clone_list);
+    }
+    trajectory.finish();
+    outfile.flush();
+    outfile.close();
+    resetWriter();
+}
+
+EventLogWriter::EventLogWriter(string ofile): DuringOutputWriter(ofile){
+    ofile_name = "events_sim_";
+}
+
+EventLogWriter::~EventLogWriter(){
+    outfile.flush();
+    outfile.close();
+}
+
+bool EventLogWriter::readLine(vector<string>& parsed_line){
+    return parsed_line.size() == 0;
+}
+
+void EventLogWriter::beginAction(CList& clone_list){
+    outfile.open(ofile_loc + ofile_name + to_string(sim_number) + ".elog", ios::out, OutputKey("EventLog", sim_number, -1));
+    log.begin(outfile, clone_list.getMaxTypes());
+    clone_list.startLog(log);
+}
+
+void EventLogWriter::duringSimAction(CList& clone_list){
+    int new_type = -1;
+    int parent = -1;
+    MutationHandler& mut_handler = clone_list.getMutHandler();
+    if (mut_handler.has_mut()){
+        new_type = mut_handler.getNewType().getIndex();
+        if (mut_handler.getNewType().getParent()){
+            parent = mut_handler.getNewType().getParent()->getIndex();
+        }
+    }
+    log.endStep(clone_list.getCurrTime(), new_type, parent, clone_list.getMotherBirth(), clone_list.getDaughterBirth());
+}
+
+void EventLogWriter::finalAction(CList& clone_list){
+    clone_list.stopLog();
+    log.finish(clone_list.isExtinct());
+    outfile.flush();
+    outfile.close();
+    resetWriter();
+}
+
+SnapshotWriter::SnapshotWriter(string ofile): DuringOutputWriter(ofile){
+    ofile_name = "snapshot_sim_";
+    binary = true;
+    has_written = false;
+    last_time = 0;
+}
+
+SnapshotWriter::~SnapshotWriter(){
+    outfile.flush();
+    outfile.close();
+}
+
+bool SnapshotWriter::readLine(vector<string>& parsed_line){
+    if (parsed_line.size() != 1){
+        return false;
+    }
+    try{
+        writing_period =stoi(parsed_line[0]);
+    }
+    catch (...){
+        return false;
+    }
+    // period 0 would copy the whole population after every event
+    return writing_period > 0 || grid.isActive();
+}
+
+void SnapshotWriter::beginAction(CList& clone_list){
+    outfile.open(ofile_loc + ofile_name + to_string(sim_number) + ".bevo", ios::out, OutputKey("Snapshot", sim_number, -1));
+    has_written = false;
+}
+
+void SnapshotWriter::writeState(CList& clone_list, double time){
+    has_written = true;
+    last_time = time;
+    string label = "sim number " + to_string(sim_number) + " time " + to_string(time);
+    trajectory.begin(outfile, "types " + label);
+    trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+    trajectory.addColumn("type", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("parent", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("cells", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    CellType *curr_type = clone_list.getFirstType();
+    while (curr_type){
+        int parent = curr_type->getParent() ? curr_type->getParent()->getIndex() : -1;
+        trajectory.add(time).add(curr_type->getIndex()).add(parent).add(curr_type->getNumCells()).endRow();
+        curr_type = curr_type->getNext();
+    }
+    trajectory.finish();
+
+    trajectory.begin(outfile, "clones " + label);
+    trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+    trajectory.addColumn("type", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("birth_rate", TrajectoryColumn::REAL);
+    trajectory.addColumn("cells", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    curr_type = clone_list.getFirstType();
+    while (curr_type){
+        Clone *curr_clone = curr_type->getRoot();
+        while (curr_clone){
+            if (curr_clone->getCellCount() > 0){
+                trajectory.add(time).add(curr_type->getIndex()).add(curr_clone->getBirthRate()).add(curr_clone->getCellCount()).endRow();
+            }
+            curr_clone = &(curr_clone->getNextWithinType());
+        }
+        curr_type = curr_type->getNext();
+    }
+    trajectory.finish();
+}
+
+void SnapshotWriter::duringSimAction(CList& clone_list){
+    if (shouldWrite(clone_list)){
+        writeState(clone_list, clone_list.getCurrTime());
+    }
+}
+
+void SnapshotWriter::finalAction(CList& clone_list){
+    if (grid.isActive()){
+        finishGrid(clone_list);
+    }
+    // the last grid time may already hold the final state, or be past it if the population went extinct
+    if (!has_written || last_time < clone_list.getCurrTime()){
+        writeState(clone_list, clone_list.getCurrTime());
+    }
+    outfile.flush();
+    outfile.close();
+    resetWriter();
+}
+
+PhylogenyWriter::PhylogenyWriter(string ofile): DuringOutputWriter(ofile){
+    ofile_name = "phylogeny_sim_";
+    binary = true;
+}
+
+PhylogenyWriter::~PhylogenyWriter(){
+    outfile.flush();
+    outfile.close();
+}
+
+bool PhylogenyWriter::readLine(vector<string>& parsed_line){
+    return parsed_line.size() == 0;
+}
+
+void PhylogenyWriter::beginAction(CList& clone_list){
+    outfile.open(ofile_loc + ofile_name + to_string(sim_number) + ".bevo", ios::out, OutputKey("Phylogeny", sim_number, -1));
+    clone_list.trackPhylogeny(phylogeny);
+}
+
+void PhylogenyWriter::finalAction(CList& clone_list){
+    clone_list.untrackPhylogeny();
+    trajectory.begin(outfile, "phylogeny sim number " + to_string(sim_number));
+    trajectory.addColumn("birth_time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+    trajectory.addColumn("type", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("parent", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("extinction_time", TrajectoryColumn::REAL);
+    trajectory.addColumn("peak", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    trajectory.addColumn("cells", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+    const vector<TypeRecord>& records = phylogeny.getRecords();
+    for (size_t i=0; i<records.size(); i++){
+        const TypeRecord& record = records[i];
+        trajectory.add(record.birth_time).add(record.index).add(record.parent).add(record.extinction_time).add(record.peak).add(record.cells).endRow();
+    }
+    trajectory.finish();
+    outfile.flush();
+    outfile.close();
+    resetWriter();
+}
+
+pthread_mutex_t AggregateWriter::lock = PTHREAD_MUTEX_INITIALIZER;
+map<string, EnsembleSummary> AggregateWriter::merged;
+map<string, OutputKey> AggregateWriter::merged_keys;
+
+AggregateWriter::AggregateWriter(string ofile): DuringOutputWriter(ofile){
+    index = -1;
+    interval = 1;
+    end_time = 0;
+    accuracy = 0.01;
+    next_point = 0;
+    last_count = 0;
+}
+
+bool AggregateWriter::readLine(vector<string>& parsed_line){
+    if (parsed_line.size() != 3 && parsed_line.size() != 4){
+        return false;
+    }
+    try{
+        interval =stod(parsed_line[0]);
+        end_time =stod(parsed_line[1]);
+        index =stoi(parsed_line[2]);
+        if (parsed_line.size() == 4){
+            accuracy =stod(parsed_line[3]);
+        }
+    }
+    catch (...){
+        return false;
+    }
+    if (interval <= 0 || end_time < 0 || accuracy <= 0 || accuracy >= 1){
+        return false;
+    }
+    summary.setGrid(interval, int(floor(end_time / interval + 1e-9)) + 1, accuracy);
+    ofile_name = index < 0 ? "aggregate_all_types.oevo" : "aggregate_type_" + to_string(index) + ".oevo";
+    return true;
+}
+
+long long AggregateWriter::countCells(CList& clone_list){
+    if (index < 0){
+        return clone_list.getNumCells();
+    }
+    return clone_list.hasCellType(index) ? clone_list.getTypeByIndex(index)->getNumCells() : 0;
+}
+
+void AggregateWriter::beginAction(CList& clone_list){
+    next_point = 0;
+    last_count = countCells(clone_list);
+}
+
+void AggregateWriter::duringSimAction(CList& clone_list){
+    // the count before this event held at every grid point before its time
+    double time = clone_list.getCurrTime();
+    while (next_point < summary.getNumPoints() && summary.pointTime(next_point) < time){
+        summary.addPoint(next_point, last_count);
+        next_point++;
+    }
+    last_count = countCells(clone_list);
+}
+
+void AggregateWriter::finalAction(CList& clone_list){
+    double time = clone_list.getCurrTime();
+    bool extinct = clone_list.isExtinct();
+    long long num_cells = countCells(clone_list);
+    // an extinct population stays that way; otherwise nothing is known past the end of the simulation
+    while (next_point < summary.getNumPoints() && (extinct || summary.pointTime(next_point) <= time)){
+        summary.addPoint(next_point, num_cells);
+        next_point++;
+    }
+    summary.addEnd(time, extinct);
+}
+
+void AggregateWriter::endAction(){
+    string filename = ofile_loc + ofile_name;
+    pthread_mutex_lock(&lock);
+    map<string, EnsembleSummary>::iterator found = merged.find(filename);
+    if (found == merged.end()){
+        merged[filename] = summary;
+        merged_keys[filename] = OutputKey("Aggregate", -1, index);
+    }
+    else{
+        found->second.merge(summary);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void AggregateWriter::writeAll(){
+    pthread_mutex_lock(&lock);
+    for (map<string, EnsembleSummary>::iterator it = merged.begin(); it != merged.end(); ++it){
+        OutputFile outfile;
+        outfile.open(it->first, ios::out, merged_keys[it->first]);
+        it->second.write(outfile);
+        outfile.flush();
+        outfile.close();
+    }
+    merged.clear();
+    merged_keys.clear();
+    pthread_mutex_unlock(&lock);
+}
+
+FitnessHistWriter::FitnessHistWriter(string ofile): DuringOutputWriter(ofile){
+    index = -1;
+}
+
+FitnessHistWriter::~FitnessHistWriter(){
+    outfile.flush();
+    outfile.close();
+}
+
+bool FitnessHistWriter::readLine(vector<string>& parsed_line){
+    if (parsed_line.size() < 3){
+        return false;
+    }
+    try{
+        writing_period =stoi(parsed_line[0]);
+        index =stoi(parsed_line[1]);
+        if (parsed_line[2] == "fixed" && parsed_line.size() == 6){
+            int num_bins = stoi(parsed_line[3]);
+            double min_rate = stod(parsed_line[4]);
+            double max_rate = stod(parsed_line[5]);
+            if (num_bins < 1 || max_rate <= min_rate){
+                return false;
+            }
+            histogram.setFixed(num_bins, min_rate, max_rate);
+        }
+        else if (parsed_line[2] == "relative" && parsed_line.size() == 4){
+            double accuracy = stod(parsed_line[3]);
+            if (accuracy <= 0 || accuracy >= 1){
+                return false;
+            }
+            histogram.setRelative(accuracy);
+        }
+        else{
+            return false;
+        }
+    }
+    catch (...){
+        return false;
+    }
+    histogram.setType(index);
+    ofile_name = index < 0 ? "all_types.oevo" : "type_" + to_string(index) + ".oevo";
+    return true;
+}
+
+void FitnessHistWriter::beginAction(CList& clone_list){
+    string ofile_middle = "fit_hist_sim_"+to_string(sim_number);
+    outfile.open(ofile_loc + ofile_middle + outputName(ofile_name), ios::app, OutputKey("FitnessHist", sim_number, index));
+    clone_list.trackFitness(histogram);
+    string label = "data for cell type " + to_string(index) + " sim number " + to_string(sim_number);
+    // the bin edges are the second line of the file
+    ostringstream edges;
+    if (histogram.getMode() == FitnessHistogram::FIXED){
+        edges << "edges";
+        for (int i=0; i<=histogram.getNumBins(); i++){
+            edges << ", " << histogram.getEdge(i);
+        }
+    }
+    if (binary){
+        trajectory.begin(outfile, edges.str() == "" ? label : label + "\n" + edges.str());
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA);
+        trajectory.addColumn("cells", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+        if (histogram.getMode() == FitnessHistogram::FIXED){
+            trajectory.addColumn("below", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+            for (int i=0; i<histogram.getNumBins(); i++){
+                trajectory.addColumn("bin_" + to_string(i), TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+            }
+            trajectory.addColumn("above", TrajectoryColumn::INTEGER, TrajectoryColumn::DELTA);
+        }
+        else{
+            const char *names[] = {"mean", "min", "p5", "p25", "p50", "p75", "p95", "max"};
+            for (int i=0; i<8; i++){
+                trajectory.addColumn(names[i], TrajectoryColumn::REAL);
+            }
+        }
+        return;
+    }
+    outfile << label << endl;
+    if (edges.str() != ""){
+        outfile << edges.str() << endl;
+    }
+}
+
+void FitnessHistWriter::writeState(CList& clone_list, double curr_time){
+    if (histogram.isStale()){
+        clone_list.fillHistogram(histogram);
+    }
+    if (histogram.getTotal() <= 0){
+        return;
+    }
+    if (histogram.getMode() == FitnessHistogram::FIXED){
+        if (binary){
+            trajectory.add(curr_time).add(histogram.getTotal()).add(histogram.getUnderflow());
+            for (int i=0; i<histogram.getNumBins(); i++){
+                trajectory.add(histogram.getBin(i));
+            }
+            trajectory.add(histogram.getOverflow()).endRow();
+            return;
+        }
+        outfile << curr_time << ", " << histogram.getTotal() << ", " << histogram.getUnderflow();
+        for (int i=0; i<histogram.getNumBins(); i++){
+            outfile << ", " << histogram.getBin(i);
+        }
+        outfile << ", " << histogram.getOverflow() << endl;
+        return;
+    }
+    const double quantiles[] = {0, 0.05, 0.25, 0.5, 0.75, 0.95, 1};
+    if (binary){
+        trajectory.add(curr_time).add(histogram.getTotal()).add(histogram.getMean());
+        for (int i=0; i<7; i++){
+            trajectory.add(histogram.quantile(quantiles[i]));
+        }
+        trajectory.endRow();
+        return;
+    }
+    outfile << curr_time << ", " << histogram.getTotal() << ", " << histogram.getMean();
+    for (int i=0; i<7; i++){
+        outfile << ", " << histogram.quantile(quantiles[i]);
+    }
+    outfile << endl;
+}
+
+void FitnessHistWriter::duringSimAction(CList& clone_list){
+    if (shouldWrite(clone_list)){
+        writeState(clone_list, clone_list.getCurrTime());
+    }
+}
+
+void FitnessHistWriter::finalAction(CList& clone_list){
+    if (grid.isActive()){
+        finishGrid(clone_list);
+    }
+    else{
+        writeState(clone_list, clone_list.getCurrTime());
+    }
+    clone_list.untrackFitness(histogram);
+    trajectory.finish();
     outfile.flush();
     outfile.close();
     resetWriter();
@@ -627,7 +1218,14 @@ NewMutantWriter::~NewMutantWriter(){
 
 void NewMutantWriter::beginAction(CList& clone_list){
     ofile_name = "sim_num_" + to_string(sim_number) + "_new_mutant_" + to_string(index) + ".oevo";
-    outfile.open(ofile_loc + ofile_name, ios::app);
+    outfile.open(ofile_loc + outputName(ofile_name), ios::app, OutputKey("NewMutant", sim_number, index));
+    if (binary){
+        trajectory.begin(outfile, "");
+        trajectory.addColumn("sim", TrajectoryColumn::INTEGER);
+        trajectory.addColumn("time", TrajectoryColumn::REAL, TrajectoryColumn::DELTA, TrajectoryColumn::FIXED);
+        trajectory.addColumn("daughter_birth", TrajectoryColumn::REAL, TrajectoryColumn::RAW, TrajectoryColumn::FIXED);
+        trajectory.addColumn("total_birth", TrajectoryColumn::REAL, TrajectoryColumn::RAW, TrajectoryColumn::FIXED);
+    }
     if (clone_list.hasCellType(index) && clone_list.getTypeByIndex(index)->getNumCells() > 0){
         has_mutant = true;
     }
@@ -635,6 +1233,7 @@ void NewMutantWriter::beginAction(CList& clone_list){
 }
 
 void NewMutantWriter::finalAction(CList &clone_list){
+    trajectory.finish();
     outfile.flush();
     outfile.close();
     //delete to_write;
@@ -643,7 +1242,11 @@ void NewMutantWriter::finalAction(CList &clone_list){
 
 void NewMutantWriter::duringSimAction(CList &clone_list){
     if (clone_list.getMutType() == index){
-        if (clone_list.getMutHandler().has_mut()){
+        if (clone_list.getMutHandler().has_mut() && binary){
+            trajectory.add(sim_number).add(clone_list.getCurrTime()).add(clone_list.getDaughterBirth()).add(clone_list.getTotalBirth()).endRow();
+            has_mutant = true;
+        }
+        else if (clone_list.getMutHandler().has_mut()){
             string new_line = to_string(sim_number) + ", " + to_string(clone_list.getCurrTime());
             new_line += ", " + to_string(clone_list.getDaughterBirth());
             new_line += ", " + to_string(clone_list.getTotalBirth());
@@ -13,6 +13,15 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include "OutputFile.h"
+#include "BinaryTrajectory.h"
+#include "FitnessHistogram.h"
+#include "EventLog.h"
+#include "EnsembleStats.h"
+#include "SampleGrid.h"
+#include "Phylogeny.h"
+#include <map>
+#include <pthread.h>
 
 using namespace std;
 
@@ -30,9 +39,20 @@ public:
     virtual void duringSimAction(CList& clone_list) = 0;
     virtual void beginAction(CList& clone_list) = 0;
     virtual bool readLine(vector<string>& parsed_line) = 0;
+    // called once by each simulation thread after its last simulation
+    virtual void endAction(){};
+    // called before every call to CList::advance, while the population is still in the state that holds until the next event
+    virtual void beforeAdvance(CList& clone_list){};
+    // writers that record the state of the population (rather than events) can sample it at the times of a grid
+    virtual bool supportsGrid(){
+        return false;
+    }
+    virtual void setGrid(const SampleGrid& new_grid){};
     void setSimNumber(int new_num){
         sim_number = new_num;
     }
+    // selects the binary .bevo format instead of text, for writers that support it
+    virtual void setBinary(bool new_binary){};
     OutputWriter();
 };
 
@@ -54,13 +74,33 @@ class DuringOutputWriter: public OutputWriter{
 protected:
     int writing_period;
     int last_written;
+    bool binary;
+    // rows of the current simulation when writing binary
+    TrajectoryEncoder trajectory;
+    // sample times replacing writing_period, empty unless the writer line ends in a grid
+    SampleGrid grid;
+    // always false with a grid, which writes from beforeAdvance instead
     bool shouldWrite(CList& clone_list);
     void resetWriter(){
         last_written = 0;
+        grid.reset();
     };
+    // writes the state of the population as it is at the given time, for writers that support a grid
+    virtual void writeState(CList& clone_list, double time){};
+    // writes the grid times up to the end of the simulation, or every remaining one if the population is extinct
+    void finishGrid(CList& clone_list);
+    // @return name with the .bevo extension in place of .oevo when writing binary
+    string outputName(const string& name);
 public:
     DuringOutputWriter(string ofile, int period);
     DuringOutputWriter(string ofile);
+    void setBinary(bool new_binary){
+        binary = new_binary;
+    }
+    void setGrid(const SampleGrid& new_grid){
+        grid = new_grid;
+    }
+    void beforeAdvance(CList& clone_list);
     virtual void finalAction(CList& clone_list) = 0;
     virtual void duringSimAction(CList& clone_list) = 0;
     virtual void beginAction(CList& clone_list) = 0;
@@ -69,7 +109,7 @@ public:
 
 class CountStepWriter: public DuringOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
     int timestep;
     int index;
 public:
@@ -86,7 +126,7 @@ public:
 
 class MotherDaughterWriter: public DuringOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
     int timestep;
     int index;
 public:
@@ -103,7 +143,7 @@ public:
 
 class NumMutationsWriter: public DuringOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
     int index;
 public:
     NumMutationsWriter(string ofile);
@@ -119,7 +159,7 @@ public:
 
 class TypeStructureWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     TypeStructureWriter(string ofile);
     ~TypeStructureWriter();
@@ -129,9 +169,17 @@ public:
 };
 
 class CellCountWriter: public DuringOutputWriter{
+    /* writes the number of cells of a type. with changes_only, a line is written only when that number changes (and at the start and end),
+     so the output grows with the events of this type rather than with every event of the simulation.
+     */
 private:
     int index;
-    ofstream outfile;
+    bool changes_only;
+    // count in the last line written
+    long long last_count;
+    OutputFile outfile;
+    void write_count(double time, long long num_cells);
+    void writeState(CList& clone_list, double time);
 public:
     ~CellCountWriter();
     CellCountWriter(string ofile, int period, int i, int sim);
@@ -143,13 +191,21 @@ public:
     int getTypeIndex(){
         return index;
     }
+    void setChangesOnly(bool new_changes_only){
+        changes_only = new_changes_only;
+    }
+    bool supportsGrid(){
+        return !changes_only;
+    }
 };
 
 class FitnessDistWriter: public DuringOutputWriter{
 private:
     int index;
-    ofstream outfile;
-    void write_dist(ofstream& outfile, CList& clone_list);
+    OutputFile outfile;
+    void write_dist(ostream& outfile, CList& clone_list);
+    void write_dist(TrajectoryEncoder& trajectory, CList& clone_list, double time);
+    void writeState(CList& clone_list, double time);
 public:
     ~FitnessDistWriter();
     FitnessDistWriter(string ofile, int period, int i, int sim);
@@ -161,12 +217,136 @@ public:
     int getTypeIndex(){
         return index;
     }
+    bool supportsGrid(){
+        return true;
+    }
+};
+
+class FitnessHistWriter: public DuringOutputWriter{
+    /* writes a summary of the birth rate distribution of one type (or of every type, for index -1) at each write period.
+     the histogram is kept up to date by the CList at every birth and death, so a write costs O(bins) rather than O(cells).
+     with fixed bins, each line is the time, number of cells, cells below the range, the count in each bin and cells above the range.
+     with relative bins, each line is the time, number of cells, mean birth rate, then the minimum, 5th, 25th, 50th, 75th and 95th percentiles and maximum.
+     */
+private:
+    int index;
+    FitnessHistogram histogram;
+    OutputFile outfile;
+    void writeState(CList& clone_list, double time);
+public:
+    ~FitnessHistWriter();
+    FitnessHistWriter(string ofile);
+    void finalAction(CList& clone_list);
+    void duringSimAction(CList& clone_list);
+    void beginAction(CList& clone_list);
+    bool readLine(vector<string>& parsed_line);
+    int getTypeIndex(){
+        return index;
+    }
+    bool supportsGrid(){
+        return true;
+    }
+};
+
+class EventLogWriter: public DuringOutputWriter{
+    /* records every birth, death and mutation of each simulation to events_sim_[number].elog, from which evo_sim -r replays it through any other writers.
+     takes no parameters and records after every event.
+     */
+private:
+    OutputFile outfile;
+    EventLog log;
+public:
+    ~EventLogWriter();
+    EventLogWriter(string ofile);
+    void finalAction(CList& clone_list);
+    void duringSimAction(CList& clone_list);
+    void beginAction(CList& clone_list);
+    bool readLine(vector<string>& parsed_line);
+};
+
+class AggregateWriter: public DuringOutputWriter{
+    /* summarizes every simulation of the run in one small file: the number of cells of a type (or of every type, for index -1)
+     at each point of a time grid, the end times and the extinction probability (see EnsembleSummary).
+     each thread accumulates its own simulations; the threads' summaries are merged when they finish and written by writeAll once the run is over.
+     */
+private:
+    int index;
+    double interval;
+    double end_time;
+    double accuracy;
+    EnsembleSummary summary;
+    // grid point to record next, and the count since the last event
+    int next_point;
+    long long last_count;
+    long long countCells(CList& clone_list);
+    static pthread_mutex_t lock;
+    // merged summaries by file name
+    static map<string, EnsembleSummary> merged;
+    static map<string, OutputKey> merged_keys;
+public:
+    AggregateWriter(string ofile);
+    void finalAction(CList& clone_list);
+    void duringSimAction(CList& clone_list);
+    void beginAction(CList& clone_list);
+    bool readLine(vector<string>& parsed_line);
+    void endAction();
+    // writes the merged summaries. call after every simulation thread has finished.
+    static void writeAll();
+    int getTypeIndex(){
+        return index;
+    }
+    const string& getFileName(){
+        return ofile_name;
+    }
+};
+
+class SnapshotWriter: public DuringOutputWriter{
+    /* writes the whole population at each write period or grid time, and at the end of the simulation, to snapshot_sim_[number].bevo.
+     each snapshot is two segments: one row per type (time, type, parent or -1, cells) and one row per clone (time, type, birth rate, cells).
+     always binary, since a snapshot lists every clone; evo_convert gives the text form.
+     */
+private:
+    OutputFile outfile;
+    // time of the last snapshot of this simulation, if any
+    bool has_written;
+    double last_time;
+    void writeState(CList& clone_list, double time);
+public:
+    ~SnapshotWriter();
+    SnapshotWriter(string ofile);
+    void setBinary(bool new_binary){};
+    void finalAction(CList& clone_list);
+    void duringSimAction(CList& clone_list);
+    void beginAction(CList& clone_list);
+    bool readLine(vector<string>& parsed_line);
+    bool supportsGrid(){
+        return true;
+    }
+};
+
+class PhylogenyWriter: public DuringOutputWriter{
+    /* writes the tree of every type of a simulation to phylogeny_sim_[number].bevo when it ends: one row per type, in order of creation,
+     with its birth time, index, parent index (-1 for none), extinction time (-1 if it has cells), peak number of cells and final number of cells.
+     the tree is recorded by the CList as types are created. always binary; evo_convert exports it as text, CSV, Newick or JSON.
+     */
+private:
+    OutputFile outfile;
+    Phylogeny phylogeny;
+public:
+    ~PhylogenyWriter();
+    PhylogenyWriter(string ofile);
+    void setBinary(bool new_binary){};
+    void finalAction(CList& clone_list);
+    void duringSimAction(CList& clone_list){};
+    void beginAction(CList& clone_list);
+    bool readLine(vector<string>& parsed_line);
 };
 
 class MeanFitWriter: public DuringOutputWriter{
 private:
     int index;
-    ofstream outfile;
+    OutputFile outfile;
+    void writeState(CList& clone_list, double time);
 public:
     ~MeanFitWriter();
     MeanFitWriter(string ofile, int period, int i, int sim);
@@ -178,13 +358,16 @@ public:
     int getTypeIndex(){
         return index;
     }
+    bool supportsGrid(){
+        return true;
+    }
 };
 
 class TunnelWriter: public DuringOutputWriter{
 private:
     int index;
     bool tunneled;
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~TunnelWriter();
     TunnelWriter(string ofile);
@@ -200,6 +383,7 @@ public:
 class AllTypesWriter: public DuringOutputWriter{
 private:
     vector<CellCountWriter *> writers;
+    bool changes_only;
 public:
     ~AllTypesWriter();
     AllTypesWriter(string ofile, int period);
@@ -208,11 +392,15 @@ public:
     void duringSimAction(CList& clone_list);
     void beginAction(CList& clone_list);
     bool readLine(vector<string>& parsed_line);
+    bool supportsGrid(){
+        return !changes_only;
+    }
+    void beforeAdvance(CList& clone_list);
 };
 
 class IfType2Writer: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~IfType2Writer();
     IfType2Writer(string ofile);
@@ -223,7 +411,7 @@ public:
 
 class IfTypeWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
     int index;
 public:
     ~IfTypeWriter();
@@ -235,7 +423,7 @@ public:
 
 class IsExtinctWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~IsExtinctWriter();
     IsExtinctWriter(string ofile);
@@ -246,7 +434,7 @@ public:
 
 class EndTimeWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~EndTimeWriter();
     EndTimeWriter(string ofile);
@@ -257,7 +445,7 @@ public:
 
 class EndPopWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~EndPopWriter();
     EndPopWriter(string ofile);
@@ -268,7 +456,7 @@ public:
 
 class EndPopTypesWriter: public FinalOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
 public:
     ~EndPopTypesWriter();
     EndPopTypesWriter(string ofile);
@@ -279,7 +467,7 @@ public:
 
 class NewMutantWriter: public DuringOutputWriter{
 private:
-    ofstream outfile;
+    OutputFile outfile;
     int index;
     bool has_mutant;
     //vector<string> *to_write;
@@ -0,0 +1,29 @@
+//
+//  Phylogeny.cpp
+//  evo_sim
+//
+//  Tree of cell types recorded as types are created, with their birth and extinction times and peak sizes.
+//
+
+#include "Phylogeny.h"
+
+void Phylogeny::clear(int max_types){
+    records.clear();
+    record_of.assign(max_types, -1);
+}
+
+void Phylogeny::addType(int index, int parent, double time, long long cells){
+    if (index < 0 || index >= int(record_of.size())){
+        return;
+    }
+    TypeRecord record;
+    record.index = index;
+    record.parent = parent;
+    record.birth_time = time;
+    record.extinction_time = -1;
+    record.peak = 0;
+    record.cells = 0;
+    record_of[index] = int(records.size());
+    records.push_back(record);
+    cellsChanged(index, cells, time);
+}
@@ -0,0 +1,60 @@
+//
+//  Phylogeny.hpp
+//  evo_sim
+//
+//  Tree of cell types recorded as types are created, with their birth and extinction times and peak sizes.
+//
+
+#ifndef Phylogeny_h
+#define Phylogeny_h
+
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+struct TypeRecord{
+    int index;
+    // index of the type this one first arose from, or -1 for a type present at the start
+    int parent;
+    double birth_time;
+    // time the type last lost its last cell, or -1 if it has cells. in the sexual model, the first generation with none of its cells
+    double extinction_time;
+    long long peak;
+    long long cells;
+};
+
+class Phylogeny{
+    /* one record per type, kept up to date by the CList as types are created and gain or lose cells,
+     so writing the tree costs O(types) rather than a walk over the whole typespace.
+     */
+private:
+    // in order of creation, so birth times never decrease
+    vector<TypeRecord> records;
+    // position in records of each type index, or -1
+    vector<int> record_of;
+public:
+    void clear(int max_types);
+    void addType(int index, int parent, double time, long long cells);
+    void cellsChanged(int index, long long cells, double time){
+        if (index < 0 || index >= int(record_of.size()) || record_of[index] < 0){
+            return;
+        }
+        TypeRecord& record = records[record_of[index]];
+        record.cells = cells;
+        if (cells > record.peak){
+            record.peak = cells;
+        }
+        if (cells > 0){
+            record.extinction_time = -1;
+        }
+        else if (record.extinction_time < 0){
+            record.extinction_time = time;
+        }
+    }
+    const vector<TypeRecord>& getRecords(){
+        return records;
+    }
+};
+
+#endif /* Phylogeny_h */
@@ -0,0 +1,69 @@
+//
+//  SampleGrid.cpp
+//  evo_sim
+//
+//  Times at which a writer samples the state of the population.
+//
+
+#include "SampleGrid.h"
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+SampleGrid::SampleGrid(){
+    next = 0;
+}
+
+bool SampleGrid::readLine(vector<string>& parsed_line){
+    times.clear();
+    next = 0;
+    if (parsed_line.size() < 2){
+        return false;
+    }
+    string kind = parsed_line[0];
+    try{
+        if (kind == "linear" && parsed_line.size() == 4){
+            double start = stod(parsed_line[1]);
+            double end = stod(parsed_line[2]);
+            double step = stod(parsed_line[3]);
+            if (step <= 0 || end < start){
+                return false;
+            }
+            // multiples of step rather than a running sum, so the times do not drift
+            long long num_points = (long long)(floor((end - start) / step + 1e-9)) + 1;
+            for (long long i=0; i<num_points; i++){
+                times.push_back(start + i * step);
+            }
+        }
+        else if (kind == "log" && parsed_line.size() == 4){
+            double start = stod(parsed_line[1]);
+            double end = stod(parsed_line[2]);
+            int num_points = stoi(parsed_line[3]);
+            if (start <= 0 || end <= start || num_points < 2){
+                return false;
+            }
+            double log_ratio = log(end / start);
+            for (int i=0; i<num_points; i++){
+                times.push_back(start * exp(log_ratio * i / (num_points - 1)));
+            }
+            times.back() = end;
+        }
+        else if (kind == "list" && parsed_line.size() == 2){
+            std::stringstream ss;
+            ss.str(parsed_line[1]);
+            string tok;
+            while (getline(ss, tok, ',')){
+                times.push_back(stod(tok));
+            }
+            sort(times.begin(), times.end());
+        }
+        else{
+            return false;
+        }
+    }
+    catch (...){
+        times.clear();
+        return false;
+    }
+    return !times.empty();
+}
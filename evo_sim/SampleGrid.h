@@ -0,0 +1,49 @@
+//
+//  SampleGrid.hpp
+//  evo_sim
+//
+//  Times at which a writer samples the state of the population.
+//
+
+#ifndef SampleGrid_h
+#define SampleGrid_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class SampleGrid{
+    /* a sorted list of sample times, evenly spaced, log spaced or given explicitly.
+     a writer with a grid records the state in effect at each of these times (the state after the last event at or before it)
+     instead of writing after events whose floored time is a multiple of its period, so every simulation is sampled at the same times.
+     */
+private:
+    vector<double> times;
+    // index of the next time to sample
+    int next;
+public:
+    SampleGrid();
+    /* @param parsed_line "linear [start] [end] [step]", "log [start] [end] [number of points]" or "list [t1,t2,...]"
+     @return false if the grid is malformed
+     */
+    bool readLine(vector<string>& parsed_line);
+    bool isActive(){
+        return !times.empty();
+    }
+    void reset(){
+        next = 0;
+    }
+    bool hasNext(){
+        return next < int(times.size());
+    }
+    double nextTime(){
+        return times[next];
+    }
+    void advance(){
+        next++;
+    }
+};
+
+#endif /* SampleGrid_h */
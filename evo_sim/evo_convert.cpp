@@ -0,0 +1,523 @@
+//
+//  evo_convert.cpp
+//  evo_sim
+//
+//  Converts binary output files back to the .oevo text format or to CSV.
+//
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "BinaryTrajectory.h"
+
+using namespace std;
+
+struct TimeFilter{
+    // rows are kept only if their first column is in [from, to]
+    bool active;
+    double from;
+    double to;
+    double firstValue(const TrajectoryColumn& column, long long bits){
+        if (column.type == TrajectoryColumn::REAL){
+            return TrajectoryDecoder::toReal(bits);
+        }
+        return double(bits);
+    }
+    bool keepsBlock(const TrajectoryColumn& column, const TrajectoryBlock& block){
+        return !active || (firstValue(column, block.max[0]) >= from && firstValue(column, block.min[0]) <= to);
+    }
+    bool keepsRow(const TrajectoryColumn& column, long long bits){
+        double value = firstValue(column, bits);
+        return !active || (value >= from && value <= to);
+    }
+};
+
+static string formatCSV(const TrajectoryColumn& column, long long bits){
+    if (column.type == TrajectoryColumn::INTEGER){
+        return to_string(bits);
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", TrajectoryDecoder::toReal(bits));
+    return buffer;
+}
+
+// writes one row of a segment that is not grouped
+static void writeRow(ostream& out, const string& format, const vector<TrajectoryColumn>& columns, const vector<long long>& row, bool repeated){
+    int num_columns = int(columns.size());
+    if (format == "csv"){
+        for (int c=0; c<num_columns; c++){
+            out << (c ? "," : "") << formatCSV(columns[c], row[c]);
+        }
+        out << "\n";
+        return;
+    }
+    out << TrajectoryDecoder::format(columns[0], row[0]);
+    int last = repeated ? num_columns - 1 : num_columns;
+    long long repeats = repeated ? row[num_columns-1] : 1;
+    for (long long r=0; r<repeats; r++){
+        for (int c=1; c<last; c++){
+            out << ", " << TrajectoryDecoder::format(columns[c], row[c]);
+        }
+    }
+    out << "\n";
+}
+
+struct TimeGrid{
+    /* rebuilds a trajectory at every multiple of interval from the rows that were written, each row holding until the next one.
+     this recovers the full trajectory of a writer that only records changes (TrajectoryEncoder::CHANGES); other segments are not put on the grid.
+     */
+    bool active;
+    double interval;
+    // the row in effect and the next time to write
+    bool have_row;
+    vector<long long> row;
+    double next_time;
+    void begin(){
+        have_row = false;
+        row.clear();
+    }
+    // writes the grid times before time, then makes new_row the row in effect
+    void add(ostream& out, const string& format, const vector<TrajectoryColumn>& columns, const vector<long long>& new_row, bool repeated, TimeFilter& filter, double time){
+        if (!have_row){
+            next_time = ceil(time / interval) * interval;
+            have_row = true;
+        }
+        while (next_time < time){
+            write(out, format, columns, repeated, filter);
+        }
+        row = new_row;
+    }
+    // writes the grid times up to and including time, the end of the segment
+    void finish(ostream& out, const string& format, const vector<TrajectoryColumn>& columns, bool repeated, TimeFilter& filter, double time){
+        while (have_row && next_time <= time){
+            write(out, format, columns, repeated, filter);
+        }
+        have_row = false;
+    }
+    void write(ostream& out, const string& format, const vector<TrajectoryColumn>& columns, bool repeated, TimeFilter& filter){
+        row[0] = columns[0].type == TrajectoryColumn::REAL ? TrajectoryDecoder::fromReal(next_time) : (long long)next_time;
+        if (filter.keepsRow(columns[0], row[0])){
+            writeRow(out, format, columns, row, repeated);
+        }
+        next_time += interval;
+    }
+};
+
+/* writes every segment of a .bevo file.
+ @param format "text" for the .oevo layout, "csv" for one row per line with a header, "blocks" for the block headers only
+ */
+static bool convertTrajectory(TrajectoryDecoder& decoder, ostream& out, const string& format, TimeFilter& filter, TimeGrid& grid){
+    vector<vector<long long> > values;
+    vector<long long> row;
+    string csv_header;
+    while (decoder.nextSegment()){
+        const vector<TrajectoryColumn>& columns = decoder.getColumns();
+        int num_columns = int(columns.size());
+        bool grouped = decoder.getFlags() & TrajectoryEncoder::GROUPED;
+        bool repeated = decoder.getFlags() & TrajectoryEncoder::REPEATED;
+        bool changes = decoder.getFlags() & TrajectoryEncoder::CHANGES;
+        if (format == "text"){
+            if (decoder.getLabel() != ""){
+                out << decoder.getLabel() << "\n";
+            }
+        }
+        else if (format == "csv"){
+            string header;
+            for (int c=0; c<num_columns; c++){
+                header += (c ? "," : "") + columns[c].name;
+            }
+            if (header != csv_header){
+                out << header << "\n";
+                csv_header = header;
+            }
+        }
+        else{
+            out << "segment \"" << decoder.getLabel() << "\"";
+            for (int c=0; c<num_columns; c++){
+                out << " " << columns[c].name;
+            }
+            out << "\n";
+        }
+        // the open line of a grouped segment, and the first column value it belongs to
+        bool in_group = false;
+        long long group_key = 0;
+        // only rows that hold until the next one can be carried to grid times: filling in the rows of a full trajectory would invent data
+        bool on_grid = grid.active && changes && format != "blocks" && num_columns > 0;
+        double last_time = 0;
+        grid.begin();
+        while (decoder.nextBlock()){
+            const TrajectoryBlock& block = decoder.getBlock();
+            // on a grid, rows before the time range still set the values carried into it
+            if (num_columns == 0 || (!on_grid && !filter.keepsBlock(columns[0], block))){
+                if (!decoder.skipBlock()){
+                    return false;
+                }
+                continue;
+            }
+            if (format == "blocks"){
+                out << "block " << block.num_rows << " rows";
+                for (int c=0; c<num_columns; c++){
+                    out << ", " << columns[c].name << " " << TrajectoryDecoder::format(columns[c], block.min[c]) << " to " << TrajectoryDecoder::format(columns[c], block.max[c]) << " (" << block.length[c] << " bytes)";
+                }
+                out << "\n";
+                if (!decoder.skipBlock()){
+                    return false;
+                }
+                continue;
+            }
+            if (!decoder.readBlock(values)){
+                return false;
+            }
+            for (int i=0; i<block.num_rows; i++){
+                row.resize(num_columns);
+                for (int c=0; c<num_columns; c++){
+                    row[c] = values[c][i];
+                }
+                if (on_grid){
+                    last_time = filter.firstValue(columns[0], row[0]);
+                    grid.add(out, format, columns, row, repeated, filter, last_time);
+                    continue;
+                }
+                if (!filter.keepsRow(columns[0], row[0])){
+                    continue;
+                }
+                if (format == "csv" || !grouped){
+                    writeRow(out, format, columns, row, repeated);
+                    continue;
+                }
+                if (!in_group || row[0] != group_key){
+                    if (in_group){
+                        out << "\n";
+                    }
+                    out << TrajectoryDecoder::format(columns[0], row[0]);
+                    in_group = true;
+                    group_key = row[0];
+                }
+                int last = repeated ? num_columns - 1 : num_columns;
+                long long repeats = repeated ? row[num_columns-1] : 1;
+                for (long long r=0; r<repeats; r++){
+                    for (int c=1; c<last; c++){
+                        out << ", " << TrajectoryDecoder::format(columns[c], row[c]);
+                    }
+                }
+            }
+        }
+        if (in_group){
+            out << "\n";
+        }
+        if (on_grid){
+            grid.finish(out, format, columns, repeated, filter, last_time);
+        }
+    }
+    return true;
+}
+
+struct PhylogenyNode{
+    int type;
+    int parent;
+    double birth_time;
+    double extinction_time;
+    long long peak;
+    long long cells;
+    // positions of the kept children
+    vector<int> children;
+    bool kept;
+};
+
+struct PhylogenyFilter{
+    /* which lineages a tree export keeps: every type, the types with cells at the end, the types that reached a peak of at least min_peak cells,
+     or the sampled types, each along with all of its ancestors.
+     */
+    enum Mode {ALL, ALIVE, PEAK, SAMPLED};
+    Mode mode;
+    long long min_peak;
+    set<int> sampled;
+    bool selects(const PhylogenyNode& node){
+        return mode == ALL || (mode == ALIVE && node.cells > 0) || (mode == PEAK && node.peak >= min_peak) || (mode == SAMPLED && sampled.count(node.type) > 0);
+    }
+};
+
+// adds the types with cells in any snapshot of a Snapshot writer's file to sampled
+static bool readSampledTypes(const string& filename, set<int>& sampled){
+    TrajectoryDecoder decoder;
+    if (!decoder.open(filename)){
+        return false;
+    }
+    const char *names[] = {"time", "type", "parent", "cells"};
+    vector<vector<long long> > values;
+    bool has_types = false;
+    while (decoder.nextSegment()){
+        const vector<TrajectoryColumn>& columns = decoder.getColumns();
+        bool is_types = columns.size() == 4;
+        for (int c=0; c<4 && is_types; c++){
+            is_types = columns[c].name == names[c];
+        }
+        if (!is_types){
+            // the clones segment of a snapshot holds no type its types segment lacks
+            while (decoder.nextBlock()){
+                decoder.skipBlock();
+            }
+            continue;
+        }
+        has_types = true;
+        while (decoder.nextBlock()){
+            if (!decoder.readBlock(values)){
+                return false;
+            }
+            for (int i=0; i<decoder.getBlock().num_rows; i++){
+                if (values[3][i] > 0){
+                    sampled.insert(int(values[1][i]));
+                }
+            }
+        }
+    }
+    return has_types;
+}
+
+static string formatReal(double value){
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.10g", value);
+    return buffer;
+}
+
+static void writeNode(ostream& out, const string& format, vector<PhylogenyNode>& nodes, int i, bool opening){
+    const PhylogenyNode& node = nodes[i];
+    if (format == "newick"){
+        if (opening){
+            if (!node.children.empty()){
+                out << "(";
+            }
+            return;
+        }
+        if (!node.children.empty()){
+            out << ")";
+        }
+        out << "type_" << node.type;
+        if (node.parent >= 0){
+            out << ":" << formatReal(node.birth_time - nodes[node.parent].birth_time);
+        }
+        return;
+    }
+    if (opening){
+        out << "{\"type\": " << node.type << ", \"birth_time\": " << formatReal(node.birth_time) << ", \"extinction_time\": ";
+        if (node.extinction_time < 0){
+            out << "null";
+        }
+        else{
+            out << formatReal(node.extinction_time);
+        }
+        out << ", \"peak\": " << node.peak << ", \"cells\": " << node.cells << ", \"children\": [";
+        return;
+    }
+    out << "]}";
+}
+
+/* writes each phylogeny segment of a .bevo file as one Newick tree per root type (format "newick"), or as one JSON array of root types per line (format "json").
+ branch lengths are the time between the birth of a type and the birth of its parent.
+ */
+static bool convertPhylogeny(TrajectoryDecoder& decoder, ostream& out, const string& format, PhylogenyFilter& keep){
+    const char *names[] = {"birth_time", "type", "parent", "extinction_time", "peak", "cells"};
+    vector<vector<long long> > values;
+    while (decoder.nextSegment()){
+        const vector<TrajectoryColumn>& columns = decoder.getColumns();
+        if (columns.size() != 6){
+            throw "not a phylogeny file";
+        }
+        for (int c=0; c<6; c++){
+            if (columns[c].name != names[c]){
+                throw "not a phylogeny file";
+            }
+        }
+        vector<PhylogenyNode> nodes;
+        while (decoder.nextBlock()){
+            if (!decoder.readBlock(values)){
+                return false;
+            }
+            for (int i=0; i<decoder.getBlock().num_rows; i++){
+                PhylogenyNode node;
+                node.birth_time = TrajectoryDecoder::toReal(values[0][i]);
+                node.type = int(values[1][i]);
+                node.parent = int(values[2][i]);
+                node.extinction_time = TrajectoryDecoder::toReal(values[3][i]);
+                node.peak = values[4][i];
+                node.cells = values[5][i];
+                node.kept = false;
+                nodes.push_back(node);
+            }
+        }
+        // parents by position rather than type index
+        map<int, int> position;
+        for (int i=0; i<int(nodes.size()); i++){
+            position[nodes[i].type] = i;
+        }
+        for (int i=0; i<int(nodes.size()); i++){
+            map<int, int>::iterator found = position.find(nodes[i].parent);
+            nodes[i].parent = found != position.end() && found->second != i ? found->second : -1;
+        }
+        for (int i=0; i<int(nodes.size()); i++){
+            if (!keep.selects(nodes[i])){
+                continue;
+            }
+            int j = i;
+            while (j >= 0 && !nodes[j].kept){
+                nodes[j].kept = true;
+                j = nodes[j].parent;
+            }
+        }
+        vector<int> roots;
+        for (int i=0; i<int(nodes.size()); i++){
+            if (!nodes[i].kept){
+                continue;
+            }
+            if (nodes[i].parent >= 0){
+                nodes[nodes[i].parent].children.push_back(i);
+            }
+            else{
+                roots.push_back(i);
+            }
+        }
+        if (format == "json"){
+            out << "[";
+        }
+        for (size_t r=0; r<roots.size(); r++){
+            if (format == "json" && r > 0){
+                out << ", ";
+            }
+            // depth first without recursion, since a lineage can be as long as the number of types
+            vector<pair<int, size_t> > stack;
+            stack.push_back(make_pair(roots[r], size_t(0)));
+            writeNode(out, format, nodes, roots[r], true);
+            while (!stack.empty()){
+                int i = stack.back().first;
+                size_t next_child = stack.back().second;
+                if (next_child < nodes[i].children.size()){
+                    stack.back().second++;
+                    if (next_child > 0){
+                        out << (format == "json" ? ", " : ",");
+                    }
+                    int child = nodes[i].children[next_child];
+                    writeNode(out, format, nodes, child, true);
+                    stack.push_back(make_pair(child, size_t(0)));
+                    continue;
+                }
+                writeNode(out, format, nodes, i, false);
+                stack.pop_back();
+            }
+            if (format == "newick"){
+                out << ";\n";
+            }
+        }
+        if (format == "json"){
+            out << "]\n";
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]){
+    string infilename;
+    string outfilename;
+    string format = "text";
+    TimeFilter filter;
+    filter.active = false;
+    TimeGrid grid;
+    grid.active = false;
+    PhylogenyFilter keep;
+    keep.mode = PhylogenyFilter::ALL;
+    keep.min_peak = 0;
+    char tmp;
+
+    while((tmp=getopt(argc,argv,"i:o:f:t:g:k:s:l:"))!=-1){
+        switch(tmp){
+                case 'i':
+                infilename = optarg;
+                break;
+                case 'o':
+                outfilename = optarg;
+                break;
+                case 'f':
+                format = optarg;
+                break;
+                case 't':
+                if (sscanf(optarg, "%lf,%lf", &filter.from, &filter.to) != 2){
+                    cerr << "bad time range, expected from,to" << endl;
+                    return 1;
+                }
+                filter.active = true;
+                break;
+                case 'g':
+                grid.interval = atof(optarg);
+                if (grid.interval <= 0){
+                    cerr << "bad grid interval, expected a positive number" << endl;
+                    return 1;
+                }
+                grid.active = true;
+                break;
+                case 'k':
+                if (string(optarg) == "alive"){
+                    keep.mode = PhylogenyFilter::ALIVE;
+                }
+                else{
+                    keep.mode = PhylogenyFilter::PEAK;
+                    keep.min_peak = atoll(optarg);
+                }
+                break;
+                case 's':
+                if (!readSampledTypes(optarg, keep.sampled)){
+                    cerr << "could not read snapshots from " << optarg << endl;
+                    return 1;
+                }
+                keep.mode = PhylogenyFilter::SAMPLED;
+                break;
+                case 'l':{
+                    stringstream list(optarg);
+                    string type;
+                    while (getline(list, type, ',')){
+                        keep.sampled.insert(atoi(type.c_str()));
+                    }
+                    keep.mode = PhylogenyFilter::SAMPLED;
+                    break;
+                }
+        }
+    }
+    bool is_tree = format == "newick" || format == "json";
+    if (infilename == "" || (format != "text" && format != "csv" && format != "blocks" && !is_tree)){
+        cerr << "usage: evo_convert -i [input file] -o [output file, default standard output] -f [text, csv, blocks, newick or json] -t [from,to] -g [grid interval] -k [alive or minimum peak size] -s [snapshot file] -l [type indices t1,t2,...]" << endl;
+        return 1;
+    }
+
+    TrajectoryDecoder decoder;
+    if (!decoder.open(infilename)){
+        cerr << "could not open " << infilename << endl;
+        return 1;
+    }
+    ofstream outfile;
+    if (outfilename != ""){
+        outfile.open(outfilename);
+        if (!outfile.is_open()){
+            cerr << "could not open " << outfilename << endl;
+            return 1;
+        }
+    }
+    ostream& out = outfilename != "" ? outfile : cout;
+    try{
+        bool complete = is_tree ? convertPhylogeny(decoder, out, format, keep) : convertTrajectory(decoder, out, format, filter, grid);
+        if (!complete){
+            cerr << "warning: " << infilename << " ends in the middle of a block" << endl;
+        }
+    }
+    catch (const char *err){
+        cerr << err << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+//  evo_pack.cpp
+//  evo_sim
+//
+//  Lists and extracts the entries of a packed output container.
+//
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "OutputContainer.h"
+
+using namespace std;
+
+struct EntryFilter{
+    // empty, or -1 for numbers, matches everything
+    string name;
+    string writer;
+    int sim_number;
+    int type;
+    bool matches(const ContainerEntry& entry){
+        return (name == "" || entry.name == name) && (writer == "" || entry.key.writer == writer)
+            && (sim_number < 0 || entry.key.sim_number == sim_number) && (type < 0 || entry.key.type == type);
+    }
+};
+
+int main(int argc, char *argv[]){
+    string infilename;
+    string extract_folder;
+    bool to_stdout = false;
+    EntryFilter filter;
+    filter.sim_number = -1;
+    filter.type = -1;
+    char tmp;
+
+    while((tmp=getopt(argc,argv,"i:x:ce:w:s:t:"))!=-1){
+        switch(tmp){
+                case 'i':
+                infilename = optarg;
+                break;
+                case 'x':
+                extract_folder = optarg;
+                break;
+                case 'c':
+                to_stdout = true;
+                break;
+                case 'e':
+                filter.name = optarg;
+                break;
+                case 'w':
+                filter.writer = optarg;
+                break;
+                case 's':
+                filter.sim_number = atoi(optarg);
+                break;
+                case 't':
+                filter.type = atoi(optarg);
+                break;
+        }
+    }
+    if (infilename == ""){
+        cerr << "usage: evo_pack -i [container .pevo file] [-x output folder | -c] [-e entry name] [-w writer] [-s sim number] [-t type]" << endl;
+        return 1;
+    }
+
+    ContainerReader reader;
+    if (!reader.open(infilename)){
+        cerr << "could not read container " << infilename << endl;
+        return 1;
+    }
+    const vector<ContainerEntry>& entries = reader.getEntries();
+    for (int i=0; i<int(entries.size()); i++){
+        const ContainerEntry& entry = entries[i];
+        if (!filter.matches(entry)){
+            continue;
+        }
+        if (to_stdout){
+            if (!reader.extract(i, stdout)){
+                cerr << "warning: " << entry.name << " is truncated" << endl;
+            }
+        }
+        else if (extract_folder != ""){
+            string filename = extract_folder + "/" + entry.name;
+            FILE *out = fopen(filename.c_str(), "wb");
+            if (!out){
+                cerr << "could not create " << filename << endl;
+                return 1;
+            }
+            if (!reader.extract(i, out)){
+                cerr << "warning: " << entry.name << " is truncated" << endl;
+            }
+            fclose(out);
+        }
+        else{
+            unsigned long long size = 0;
+            for (size_t j=0; j<entry.lengths.size(); j++){
+                size += entry.lengths[j];
+            }
+            cout << entry.name << "\t" << entry.key.writer << "\t" << entry.key.sim_number << "\t" << entry.key.type << "\t" << size << endl;
+        }
+    }
+    return 0;
+}
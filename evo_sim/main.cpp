@@ -30,6 +30,7 @@ void *sim_thread(void *arg){
     string outfolder = data->getOutfolder();
     string infilename = data->getInfile();
     string model_type = data->getModel();
+    string replay_folder = data->getReplayFolder();
     pthread_mutex_t *write_lock = data->getWriteLock();
     
     ofstream errfile;
@@ -43,7 +44,13 @@ void *sim_thread(void *arg){
         pthread_exit(NULL);
     }
     CList* clone_list;
-    if (model_type == "moran"){
+    // the model type still decides how the input file's clones are read
+    ReplayPop *replay_pop = NULL;
+    if (replay_folder != ""){
+        replay_pop = new ReplayPop();
+        clone_list = replay_pop;
+    }
+    else if (model_type == "moran"){
         clone_list = new MoranPop();
     }
     else if (model_type == "branching"){
@@ -52,6 +59,9 @@ void *sim_thread(void *arg){
     else if (model_type == "update"){
         clone_list = new UpdateAllPop();
     }
+    else if (model_type == "diffusion"){
+        clone_list = new DiffusionEventPop();
+    }
     else if (model_type == "sexual"){
         clone_list = new SexReprPop();
     }
@@ -79,29 +89,52 @@ void *sim_thread(void *arg){
         params.refreshSim(infile);
         infile.close();
         params.setSimNumber(sim_num);
+        if (replay_pop && !replay_pop->open(replay_folder + "events_sim_" + to_string(sim_num) + ".elog")){
+            cout << "could not read the event log of simulation " << sim_num << endl;
+            sim_num = data->getSimNumberAndAdvance();
+            continue;
+        }
         
-        pthread_mutex_lock(write_lock);
+        // with I/O threads, records from different simulations are kept apart by the pipeline instead
+        bool lock_writers = !OutputPipeline::isAsync();
+        if (lock_writers){
+            pthread_mutex_lock(write_lock);
+        }
         for (vector<OutputWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
             (*it)->setSimNumber(sim_num);
             (*it)->beginAction(*clone_list);
         }
-        pthread_mutex_unlock(write_lock);
-        while (!clone_list->noTypesLeft() && !clone_list->isExtinct() && !end_conditions.shouldEnd(*clone_list)){
+        if (lock_writers){
+            pthread_mutex_unlock(write_lock);
+        }
+        while (!clone_list->noTypesLeft() && !clone_list->isExtinct() && !clone_list->isFinished() && !end_conditions.shouldEnd(*clone_list)){
+            for (vector<OutputWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
+                (*it)->beforeAdvance(*clone_list);
+            }
             clone_list->advance();
             for (vector<OutputWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
                 (*it)->duringSimAction(*clone_list);
             }
         }
-        pthread_mutex_lock(write_lock);
+        if (lock_writers){
+            pthread_mutex_lock(write_lock);
+        }
         for (vector<OutputWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
             (*it)->finalAction(*clone_list);
         }
-        pthread_mutex_unlock(write_lock);
+        if (lock_writers){
+            pthread_mutex_unlock(write_lock);
+        }
         
         sim_num = data->getSimNumberAndAdvance();
     }
     
+    for (vector<OutputWriter *>::iterator it = writers.begin(); it != writers.end(); ++it){
+        (*it)->endAction();
+    }
     delete clone_list;
+    // every history of this thread is gone with its population
+    AlterationHistory::clearFreeLists();
     delete eng;
     writers.clear();
     pthread_exit(NULL);
@@ -113,10 +146,13 @@ int main(int argc, char *argv[]){
     string model_type;
     char tmp;
     int num_cores = 1;
+    int num_io_threads = 0;
+    string container_name;
+    string replay_folder;
     pthread_mutex_t lock_sim_number;
     pthread_mutex_t lock_writers;
     
-    while((tmp=getopt(argc,argv,"i:o:m:n:"))!=-1){
+    while((tmp=getopt(argc,argv,"i:o:m:n:a:p:r:"))!=-1){
         switch(tmp){
                 case 'i':
                 infilename = optarg;
@@ -130,6 +166,15 @@ int main(int argc, char *argv[]){
                 case 'n':
                 num_cores = stoi(optarg);
                 break;
+                case 'a':
+                num_io_threads = stoi(optarg);
+                break;
+                case 'p':
+                container_name = optarg;
+                break;
+                case 'r':
+                replay_folder = optarg;
+                break;
         }
     }
     
@@ -137,11 +182,26 @@ int main(int argc, char *argv[]){
         cout << "argument issues" << endl;
         return 1;
     }
+    if (replay_folder != "" && replay_folder == outfolder){
+        // an EventLog writer in the input file would overwrite the logs being replayed
+        cout << "replayed output must go to a different folder than the event logs" << endl;
+        return 1;
+    }
     pthread_t threads[num_cores];
     int rc=0;
     pthread_mutex_init(&lock_sim_number, NULL);
     pthread_mutex_init(&lock_writers, NULL);
-    ThreadInput thread_data(&lock_sim_number, &lock_writers, outfolder, infilename, model_type);
+    ThreadInput thread_data(&lock_sim_number, &lock_writers, outfolder, infilename, model_type, replay_folder);
+    if (container_name != ""){
+        try{
+            OutputContainer::open(outfolder, container_name);
+        }
+        catch (const char *err){
+            cout << err << endl;
+            return 1;
+        }
+    }
+    OutputPipeline::start(num_io_threads);
     
     for (int i=0; i<num_cores; i++){
         
@@ -153,18 +213,22 @@ int main(int argc, char *argv[]){
     for (int i = 0; i < num_cores; ++i) {
         pthread_join(threads[i], NULL);
     }
+    AggregateWriter::writeAll();
+    OutputPipeline::stop();
+    OutputContainer::close();
     return 0;
 }
 
 //=============CLASS METHODS==================
 
-ThreadInput::ThreadInput(pthread_mutex_t *new_lock, pthread_mutex_t *new_write_lock, string new_out, string new_in, string model){
+ThreadInput::ThreadInput(pthread_mutex_t *new_lock, pthread_mutex_t *new_write_lock, string new_out, string new_in, string model, string replay){
     sim_number = 1;
     num_lock = new_lock;
     write_lock = new_write_lock;
     outfolder = new_out;
     infilename = new_in;
     model_type = model;
+    replay_folder = replay;
 }
 
 int ThreadInput::getSimNumberAndAdvance(){
@@ -175,14 +239,134 @@ int ThreadInput::getSimNumberAndAdvance(){
     return sim_num;
 }
 
+WorkerTeam::WorkerTeam(){
+    num_threads = 1;
+    generation = 0;
+    num_finished = 0;
+    shutting_down = false;
+    task = NULL;
+    context = NULL;
+    num_items = 0;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&work_ready, NULL);
+    pthread_cond_init(&work_done, NULL);
+}
+
+WorkerTeam::~WorkerTeam(){
+    stop();
+    for (vector<mt19937 *>::iterator it = engines.begin(); it != engines.end(); ++it){
+        delete *it;
+    }
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&work_ready);
+    pthread_cond_destroy(&work_done);
+}
+
+void WorkerTeam::stop(){
+    pthread_mutex_lock(&lock);
+    shutting_down = true;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    for (vector<pthread_t>::iterator it = threads.begin(); it != threads.end(); ++it){
+        pthread_join(*it, NULL);
+    }
+    threads.clear();
+    shutting_down = false;
+}
+
+void WorkerTeam::start(int num){
+    stop();
+    if (num < 1){
+        num = 1;
+    }
+    num_threads = num;
+    if (num_threads == 1){
+        return;
+    }
+    while (int(engines.size()) < num_threads){
+        engines.push_back(new mt19937());
+    }
+    for (int i=0; i<num_threads; i++){
+        std::seed_seq seq{(*eng)(), (*eng)(), (*eng)(), (*eng)()};
+        engines[i]->seed(seq);
+    }
+    members.resize(num_threads);
+    for (int i=1; i<num_threads; i++){
+        members[i].team = this;
+        members[i].id = i;
+        members[i].start_generation = generation;
+        pthread_t new_thread;
+        if (pthread_create(&new_thread, NULL, memberMain, &members[i])){
+            throw "worker thread creation failure";
+        }
+        threads.push_back(new_thread);
+    }
+}
+
+void *WorkerTeam::memberMain(void *arg){
+    Member *self = (Member *)arg;
+    WorkerTeam *team = self->team;
+    eng = team->engines[self->id];
+    long long seen = self->start_generation;
+    pthread_mutex_lock(&team->lock);
+    while (true){
+        while (team->generation == seen && !team->shutting_down){
+            pthread_cond_wait(&team->work_ready, &team->lock);
+        }
+        if (team->shutting_down){
+            break;
+        }
+        seen = team->generation;
+        pthread_mutex_unlock(&team->lock);
+        team->runBlock(self->id);
+        pthread_mutex_lock(&team->lock);
+        team->num_finished++;
+        if (team->num_finished == team->num_threads - 1){
+            pthread_cond_signal(&team->work_done);
+        }
+    }
+    pthread_mutex_unlock(&team->lock);
+    return NULL;
+}
+
+void WorkerTeam::runBlock(int thread_id){
+    long long begin = num_items * thread_id / num_threads;
+    long long end = num_items * (thread_id + 1) / num_threads;
+    task(context, thread_id, begin, end);
+}
+
+void WorkerTeam::run(long long n, Task new_task, void *new_context){
+    if (num_threads == 1){
+        new_task(new_context, 0, 0, n);
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    task = new_task;
+    context = new_context;
+    num_items = n;
+    num_finished = 0;
+    generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+
+    mt19937 *own_eng = eng;
+    eng = engines[0];
+    runBlock(0);
+    eng = own_eng;
+
+    pthread_mutex_lock(&lock);
+    while (num_finished < num_threads - 1){
+        pthread_cond_wait(&work_done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
 CellType::CellType(int i, CellType *parent_type){
     index = i;
     total_birth_rate = 0;
     parent = parent_type;
     children = std::vector<CellType *>();
-    if (parent_type){
-        empirical_dist = *parent_type->getEmpiricalDist();
-    }
+    empirical_dist = parent_type ? parent_type->empirical_dist : NULL;
     num_cells = 0;
     root_node = NULL;
     end_node = NULL;
@@ -216,6 +400,8 @@ void CellType::subtractOneCell(double b){
     }
      */
     clone_list->removeCell(b);
+    clone_list->typeCountChanged(*this, -1);
+    clone_list->cellsChanged(index, b, -1);
 }
 
 void CellType::addChild(CellType &child_type){
@@ -230,14 +416,20 @@ void CellType::addChild(CellType &child_type){
     }
 }
 
-void CellType::addCells(int num, double b){
+void CellType::addCells(long long num, double b){
     num_cells += num;
     total_birth_rate += b*num;
     
     clone_list->addCells(num, b);
+    clone_list->typeCountChanged(*this, num);
+    clone_list->cellsChanged(index, b, num);
 }
 
 CellType::~CellType(){
+    deleteClones();
+}
+
+void CellType::deleteClones(){
     Clone *to_delete = root_node;
     Clone *next;
     while (to_delete){
@@ -247,6 +439,14 @@ CellType::~CellType(){
     }
 }
 
+void CellType::detachClones(){
+    root_node = NULL;
+    end_node = NULL;
+    num_cells = 0;
+    total_birth_rate = 0;
+    clone_list->typeDetached(index);
+}
+
 void CellType::unlinkType(){
     if (next_node){
         next_node->setPrev(*prev_node);
@@ -373,6 +573,7 @@ SimParams::SimParams(CList& clist, vector<OutputWriter*>& writer_list, Composite
     has_dist = new vector<int>();
     dists = new vector<vector<int>>();
     sync_dists = false;
+    binary_output = false;
     has_list = false;
     index_list = new vector<int>();
     model_type = &sim_type;
@@ -380,6 +581,7 @@ SimParams::SimParams(CList& clist, vector<OutputWriter*>& writer_list, Composite
 
 void SimParams::refreshSim(ifstream& infile){
     clone_list->refreshSim();
+    mut_handler->refresh();
     string line;
     
     int num_drawn = -1;
@@ -446,6 +648,9 @@ bool SimParams::read(ifstream& infile){
         }
         line_num++;
     }
+    for (vector<OutputWriter *>::iterator it = writers->begin(); it != writers->end(); ++it){
+        (*it)->setBinary(binary_output);
+    }
     if (!make_mut_handler()){
         return false;
     }
@@ -632,6 +837,17 @@ bool SimParams::make_writer(vector<string> &parsed_line){
     OutputWriter *new_writer;
     string type = parsed_line[0];
     parsed_line.erase(parsed_line.begin());
+    // a trailing "grid [linear|log|list] ..." samples at those times instead of the writer's period
+    SampleGrid grid;
+    vector<string>::iterator grid_start = std::find(parsed_line.begin(), parsed_line.end(), "grid");
+    if (grid_start != parsed_line.end()){
+        vector<string> grid_line(grid_start + 1, parsed_line.end());
+        parsed_line.erase(grid_start, parsed_line.end());
+        if (!grid.readLine(grid_line)){
+            err_type = "bad writer grid";
+            return false;
+        }
+    }
     if (type == "IfType2"){
         new_writer = new IfType2Writer(*outfolder);
     }
@@ -659,6 +875,21 @@ bool SimParams::make_writer(vector<string> &parsed_line){
     else if (type == "MeanFit"){
         new_writer = new MeanFitWriter(*outfolder);
     }
+    else if (type == "FitnessHist"){
+        new_writer = new FitnessHistWriter(*outfolder);
+    }
+    else if (type == "EventLog"){
+        new_writer = new EventLogWriter(*outfolder);
+    }
+    else if (type == "Aggregate"){
+        new_writer = new AggregateWriter(*outfolder);
+    }
+    else if (type == "Snapshot"){
+        new_writer = new SnapshotWriter(*outfolder);
+    }
+    else if (type == "Phylogeny"){
+        new_writer = new PhylogenyWriter(*outfolder);
+    }
     else if (type == "NewMutant"){
         new_writer = new NewMutantWriter(*outfolder);
     }
@@ -684,10 +915,23 @@ bool SimParams::make_writer(vector<string> &parsed_line){
         err_type = "bad writer type";
         return false;
     }
+    // set before the line is read, so a writer can check its parameters against the grid
+    if (grid.isActive()){
+        new_writer->setGrid(grid);
+    }
     if (!new_writer->readLine(parsed_line)){
         err_type = "bad writer params";
         return false;
     }
+    if (grid.isActive() && !new_writer->supportsGrid()){
+        err_type = "writer does not support a grid";
+        return false;
+    }
+    // a second line for the same file would have every simulation counted twice when the summaries are merged
+    if (type == "Aggregate" && !aggregate_files.insert(((AggregateWriter *)new_writer)->getFileName()).second){
+        err_type = "duplicate Aggregate writer";
+        return false;
+    }
     writers->push_back(new_writer);
     return true;
 }
@@ -749,7 +993,7 @@ bool SimParams::make_clone(vector<string> &parsed_line){
         }
         Diffusion1DClone *new_clone;
         for (int i=0; i<num_cells; i++){
-            if (*model_type == "update"){
+            if (*model_type == "update" || *model_type == "diffusion"){
                 new_clone = new Diffusion1DClone(*new_type);
             }
             else{
@@ -954,6 +1198,18 @@ bool SimParams::handle_sim_line(vector<string>& parsed_line){
     else if (parsed_line[0] == "sim_id"){
         sim_name = parsed_line[1];
     }
+    else if (parsed_line[0] == "output_format"){
+        if (parsed_line[1] == "binary"){
+            binary_output = true;
+        }
+        else if (parsed_line[1] == "text"){
+            binary_output = false;
+        }
+        else{
+            err_type = "bad output format";
+            return false;
+        }
+    }
     return true;
 }
 
@@ -982,6 +1238,9 @@ bool SimParams::make_mut_handler(){
     else if (mut_type == "ManyTypesFlex"){
         mut_handler = new ManyTypesFlexMutation();
     }
+    else if (mut_type == "Hypercube"){
+        mut_handler = new HypercubeMutation();
+    }
     else{
         err_type = "bad mut type";
         return false;
@@ -990,6 +1249,7 @@ bool SimParams::make_mut_handler(){
         err_type = "bad mut params";
         return false;
     }
+    mut_handler->compile();
     return true;
 }
 
@@ -9,7 +9,9 @@
 #include <cstdlib>
 #include <iomanip>
 #include <vector>
+#include <set>
 #include <random>
+#include <pthread.h>
 
 using namespace std;
 
@@ -33,10 +35,12 @@ private:
     string outfolder;
     string infilename;
     string model_type;
+    // folder of the event logs to replay instead of simulating, or empty
+    string replay_folder;
     // lock for all writers in the simulation
     pthread_mutex_t *write_lock;
 public:
-    ThreadInput(pthread_mutex_t *new_lock, pthread_mutex_t *new_write_lock, string new_out, string new_in, string model);
+    ThreadInput(pthread_mutex_t *new_lock, pthread_mutex_t *new_write_lock, string new_out, string new_in, string model, string replay);
     pthread_mutex_t* getWriteLock(){
         return write_lock;
     }
@@ -53,6 +57,53 @@ public:
     string getModel(){
         return model_type;
     }
+    string getReplayFolder(){
+        return replay_folder;
+    }
+};
+
+class WorkerTeam{
+    /* a persistent team of threads that splits work inside a single simulation across cores.
+     each member, including the calling thread (which always takes the first block), has its own RNG stream and sees it through eng while working.
+     only the simulation thread that owns the team should call run(). NOT reentrant.
+     */
+public:
+    // performs items [begin, end) of a task on behalf of thread thread_id
+    typedef void (*Task)(void *context, int thread_id, long long begin, long long end);
+private:
+    struct Member{
+        WorkerTeam *team;
+        int id;
+        long long start_generation;
+    };
+    int num_threads;
+    std::vector<pthread_t> threads;
+    std::vector<Member> members;
+    std::vector<std::mt19937 *> engines;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    long long generation;
+    int num_finished;
+    bool shutting_down;
+    Task task;
+    void *context;
+    long long num_items;
+    static void *memberMain(void *arg);
+    void runBlock(int thread_id);
+    void stop();
+public:
+    WorkerTeam();
+    ~WorkerTeam();
+    /* (re)starts the team with num total threads, seeding every stream from the calling thread's engine.
+     num <= 1 means all work runs on the calling thread with its own engine.
+     */
+    void start(int num);
+    int getNumThreads(){
+        return num_threads;
+    }
+    // splits items [0, n) into one contiguous block per thread and returns once every block is done
+    void run(long long n, Task new_task, void *new_context);
 };
 
 class CellType{
@@ -72,7 +123,7 @@ private:
     bool has_death_rate;
     double death;
     int index;
-    int num_cells;
+    long long num_cells;
     double total_birth_rate;
     void unlinkType();
     void setNext(CellType& next){
@@ -89,16 +140,14 @@ private:
         end_node = &new_end;
     }
     // called every time a cell of this type is born
-    void addCells(int num, double b);
+    void addCells(long long num, double b);
     // called every time a cell of this type dies
     void subtractOneCell(double b);
     void setCloneList(CList& clist){
         clone_list = &clist;
     }
-    vector<double> empirical_dist;
-    vector<double>* getEmpiricalDist(){
-        return &empirical_dist;
-    }
+    // shared with every other type using the same file, and inherited by mutant types. NULL if none has been read.
+    const vector<double> *empirical_dist;
 public:
     /* @param i cell type id. should be unique in the clone list typespace.
      @param parent_type cell type that formed this type, via mutation. if one of the original types in simulation, then NULL.
@@ -129,7 +178,7 @@ public:
         return index;
     }
     
-    int getNumCells(){
+    long long getNumCells(){
         return num_cells;
     }
     double getBirthRate(){
@@ -151,17 +200,24 @@ public:
         return *clone_list;
     }
     void insertClone(Clone& new_clone);
-    void addDistPoint(double new_birth){
-        empirical_dist.push_back(new_birth);
+    // deletes every clone of this type
+    void deleteClones();
+    /* empties this type without deleting its clones, which must be owned elsewhere. does NOT update the population totals.
+     O(1)- used to discard a whole generation at once.
+     */
+    void detachClones();
+    // @param dist values owned by DistributionStore
+    void setDist(const vector<double> *dist){
+        empirical_dist = dist;
     }
     double getDistByIndex(int index){
-        return empirical_dist[index];
+        return (*empirical_dist)[index];
     }
     bool hasDist(){
-        return empirical_dist.size() > 0;
+        return empirical_dist != NULL;
     }
     int getDistSize(){
-        return empirical_dist.size();
+        return int(empirical_dist->size());
     }
     void setDeathRate(double death_rate);
 };
@@ -237,8 +293,12 @@ private:
     bool handle_line(string& line);
     string *outfolder;
     bool sync_dists;
+    // whether writers that support it write .bevo files rather than text
+    bool binary_output;
     bool has_list;
     vector<int> *index_list;
+    // output files of the Aggregate writers read so far, since their summaries are merged by file name
+    set<string> aggregate_files;
     
     /* handle a line that started with "sim_param".
      @param parsed_line tokenized line with parameter info. already stripped of "sim_param" keyword. first element should be parameter name to be set.